@@ -187,7 +187,7 @@ void ChatCommandClient::CheckPerimeter(const Position &pos, const float radius,
                     continue;
                 }
 
-                std::lock_guard<std::mutex> world_guard(world->GetMutex());
+                std::shared_lock<std::shared_mutex> world_guard(world->GetMutex());
 
                 const Block *block = world->GetBlock(current_position);
 
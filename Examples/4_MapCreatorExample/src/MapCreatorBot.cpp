@@ -304,16 +304,16 @@ const std::vector<Position> MapCreatorBot::GetAllChestsAround() const
 
     Position checked_position;
     {
-        std::lock_guard<std::mutex> world_guard(world->GetMutex());
+        std::shared_lock<std::shared_mutex> world_guard(world->GetMutex());
         const Block* block;
-        const std::map<std::pair<int, int>, std::shared_ptr<Chunk> >& all_chunks = world->GetAllChunks();
+        const ChunkMap& all_chunks = world->GetAllChunks();
 
         for (auto it = all_chunks.begin(); it != all_chunks.end(); ++it)
         {
             for (int x = 0; x < CHUNK_WIDTH; ++x)
             {
                 checked_position.x = it->first.first * CHUNK_WIDTH + x;
-                for (int y = 0; y < CHUNK_HEIGHT; ++y)
+                for (int y = it->second->GetMinY(); y < it->second->GetMinY() + it->second->GetHeight(); ++y)
                 {
                     checked_position.y = y;
                     for (int z = 0; z < CHUNK_WIDTH; ++z)
@@ -653,7 +653,7 @@ const bool MapCreatorBot::FindNextTask(const std::set<std::string>& available, P
             const std::string& target_name = palette[target_palette];
             std::shared_ptr<Blockstate> blockstate;
             {
-                std::lock_guard<std::mutex> world_guard(world->GetMutex());
+                std::shared_lock<std::shared_mutex> world_guard(world->GetMutex());
                 const Block* block = world->GetBlock(pos);
 
                 if (!block)
@@ -677,7 +677,7 @@ const bool MapCreatorBot::FindNextTask(const std::set<std::string>& available, P
             {
                 for (int i = 0; i < neighbour_offsets.size(); ++i)
                 {
-                    std::lock_guard<std::mutex> world_guard(world->GetMutex());
+                    std::shared_lock<std::shared_mutex> world_guard(world->GetMutex());
                     const Block* neighbour_block = world->GetBlock(pos + neighbour_offsets[i]);
 
                     if (neighbour_block && !neighbour_block->GetBlockstate()->IsAir())
@@ -695,7 +695,7 @@ const bool MapCreatorBot::FindNextTask(const std::set<std::string>& available, P
             {
                 for (int i = 0; i < neighbour_offsets.size(); ++i)
                 {
-                    std::lock_guard<std::mutex> world_guard(world->GetMutex());
+                    std::shared_lock<std::shared_mutex> world_guard(world->GetMutex());
                     const Block* neighbour_block = world->GetBlock(pos + neighbour_offsets[i]);
 
                     if (neighbour_block && !neighbour_block->GetBlockstate()->IsAir())
@@ -816,7 +816,7 @@ const bool MapCreatorBot::CheckCompletion(const bool full, const bool print_erro
                 const short target_id = target[target_pos.x][target_pos.y][target_pos.z];
                 std::shared_ptr<Blockstate> blockstate;
                 {
-                    std::lock_guard<std::mutex> world_guard(world->GetMutex());
+                    std::shared_lock<std::shared_mutex> world_guard(world->GetMutex());
                     const Block* block = world->GetBlock(world_pos);
 
                     if (!block)
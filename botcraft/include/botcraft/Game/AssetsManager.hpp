@@ -24,6 +24,16 @@ namespace Botcraft
 #else
         const std::map<int, std::shared_ptr<Blockstate> >& Blockstates() const;
 #endif
+
+        // O(1) access to a blockstate, returns the default
+        // blockstate if the id is unknown
+#if PROTOCOL_VERSION < 347
+        const std::shared_ptr<Blockstate>& GetBlockstate(const unsigned int id, const unsigned char metadata) const;
+        const BlockstateProperties& GetBlockstateProperties(const unsigned int id, const unsigned char metadata) const;
+#else
+        const std::shared_ptr<Blockstate>& GetBlockstate(const unsigned int id) const;
+        const BlockstateProperties& GetBlockstateProperties(const unsigned int id) const;
+#endif
         
 #if PROTOCOL_VERSION < 358
         const std::map<unsigned char, std::shared_ptr<Biome> >& Biomes() const;
@@ -43,6 +53,7 @@ namespace Botcraft
         AssetsManager();
 
         void LoadBlocksFile();
+        void FlattenBlockstates();
         void LoadBiomesFile();
         void LoadItemsFile();
         void ClearCaches();
@@ -53,6 +64,12 @@ namespace Botcraft
 #else
         std::map<int, std::shared_ptr<Blockstate> > blockstates;
 #endif
+        // Contiguous tables indexed by global blockstate id
+        // (id << 4 | metadata before the flattening). Never
+        // modified after construction, Block keeps pointers
+        // into flat_blockstates_properties
+        std::vector<std::shared_ptr<Blockstate> > flat_blockstates;
+        std::vector<BlockstateProperties> flat_blockstates_properties;
 #if PROTOCOL_VERSION < 358
         std::map<unsigned char, std::shared_ptr<Biome> > biomes;
 #else
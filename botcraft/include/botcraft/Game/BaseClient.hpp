@@ -37,6 +37,15 @@ namespace Botcraft
         void Connect(const std::string& address, const std::string& launcher_accounts_path);
         void Disconnect();
 
+        // If true, the next connections run on the network threads
+        // shared by all the clients of the process instead of
+        // having their own (see NetworkManager)
+        void SetUseSharedNetworkRuntime(const bool b);
+        // If true, the packets sent by the next connections during a
+        // tick are sent together at the end of the tick, with one
+        // system call, instead of one by one (see NetworkManager)
+        void SetBatchNetworkWrites(const bool b);
+
         void SetSharedWorld(const std::shared_ptr<World> world_);
 
     protected:
@@ -83,6 +92,8 @@ namespace Botcraft
 #endif
 
         bool auto_respawn;
+        bool use_shared_network_runtime;
+        bool batch_network_writes;
 
         //ProtocolCraft::ConnectionState state;
         GameType game_mode;
@@ -70,6 +70,13 @@ namespace Botcraft
         Leaves
     };
 
+    enum class Heightmap
+    {
+        MotionBlocking = 0, // Solid blocks and fluids
+        Solid,              // Solid blocks
+        NonFluid            // All blocks except air and fluids
+    };
+
     enum class Orientation
     {
         None = -1,
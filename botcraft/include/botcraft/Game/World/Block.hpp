@@ -5,6 +5,7 @@
 #include <vector>
 #include <set>
 #include <memory>
+#include <functional>
 
 #include "botcraft/Game/World/Blockstate.hpp"
 
@@ -14,22 +15,32 @@ namespace Botcraft
     {
     public:
 #if PROTOCOL_VERSION < 347
-        Block(const int id_ = 0, const unsigned char metadata_ = 0);
+        Block(const int id_ = 0, const unsigned char metadata_ = 0, const int model_id_ = -1);
 
         void ChangeBlockstate(const int id_, const unsigned char metadata_, const int model_id_ = -1);
 #else
-        Block(const int id_ = 0);
+        Block(const int id_ = 0, const int model_id_ = -1);
 
         void ChangeBlockstate(const int id_, const int model_id_ = -1);
 #endif
 
         const std::shared_ptr<Blockstate> GetBlockstate() const;
         const unsigned short GetModelId() const;
+        // Entry of the AssetsManager flat properties table, prefer it to
+        // GetBlockstate() for air/solid/fluid/transparent checks in hot
+        // paths as it doesn't copy the shared_ptr
+        const BlockstateProperties& GetProperties() const;
+
+        // Two blocks are equal if they share the same blockstate and model
+        const bool operator==(const Block& other) const;
+        const bool operator!=(const Block& other) const;
 
     private:
         std::shared_ptr<Blockstate> blockstate;
+        const BlockstateProperties* properties;
         unsigned short model_id;
     };
 
     typedef std::shared_ptr<Block> BlockPtr;
+    typedef std::function<bool(const Block&)> BlockPredicate;
 } // Botcraft
\ No newline at end of file
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <utility>
+
+#include "protocolCraft/Types/NBT/NBT.hpp"
+
+namespace Botcraft
+{
+    // Block entities data of one chunk, kept in a vector sorted
+    // by the packed position of the block in the chunk.
+    // Stored NBT are never modified, so they are handed out to
+    // readers without any copy. The vector itself is shared between
+    // all the copies of a store and only duplicated when one of
+    // them is modified, copying a chunk is then almost free
+    class BlockEntityStore
+    {
+    public:
+        using value_type = std::pair<int, std::shared_ptr<const ProtocolCraft::NBT> >;
+
+        BlockEntityStore();
+
+        // Packed index of a block given its x and z coordinates
+        // in the chunk and its y coordinate relative to the chunk
+        // min_y. The order of the indices is y, z, x
+        static constexpr int PackIndex(const int x, const int y, const int z)
+        {
+            return (y << 8) | (z << 4) | x;
+        }
+
+        // Return the data at index or nullptr if there is none
+        std::shared_ptr<const ProtocolCraft::NBT> Get(const int index) const;
+        // Insert or replace the data at index, data must not be nullptr
+        void Set(const int index, const std::shared_ptr<const ProtocolCraft::NBT>& data);
+        // Return false if there was no data at index
+        bool Erase(const int index);
+        void Clear();
+
+        const size_t size() const;
+        const bool empty() const;
+
+        // Iterate over all the block entities, sorted by index
+        std::vector<value_type>::const_iterator begin() const;
+        std::vector<value_type>::const_iterator end() const;
+
+    private:
+        // Iterator to the first entry with an index >= index
+        std::vector<value_type>::const_iterator LowerBound(const int index) const;
+        // Make sure no other store shares the entries before modifying them
+        void Detach();
+
+    private:
+        std::shared_ptr<std::vector<value_type> > entries;
+    };
+} // Botcraft
@@ -11,6 +11,17 @@
 
 namespace Botcraft
 {
+    // Properties frequently checked when querying
+    // the world, packed next to each other
+    struct BlockstateProperties
+    {
+        float hardness;
+        bool air;
+        bool solid;
+        bool transparent;
+        bool fluid;
+    };
+
     class Blockstate
     {
     public:
@@ -51,6 +62,7 @@ namespace Botcraft
         const bool IsFluid() const;
         const float GetHardness() const;
         const TintType GetTintType() const;
+        const BlockstateProperties GetProperties() const;
 
 #if PROTOCOL_VERSION < 347
         const static unsigned int IdMetadataToId(const unsigned int id_, const unsigned char metadata_);
@@ -2,36 +2,42 @@
 
 #include <vector>
 #include <map>
+#include <array>
 #include <memory>
 
 #include "botcraft/Game/World/Block.hpp"
+#include "botcraft/Game/World/BlockEntityStore.hpp"
+#include "botcraft/Game/World/Coordinates.hpp"
 #include "botcraft/Game/Enums.hpp"
+#include "protocolCraft/BinaryReadWrite.hpp"
 #include "protocolCraft/Types/NBT/NBT.hpp"
 
 namespace Botcraft
 {
     struct Section;
+    class Biome;
 
-    //We assume that a chunk is 16*256*16
-    //And a section is 16*16*16
-    static const int CHUNK_WIDTH = 16;
-    static const int SECTION_HEIGHT = 16;
+    //Default height and min y, the only possible
+    //values before 1.17
     static const int CHUNK_HEIGHT = 256;
-
-#if PROTOCOL_VERSION > 551
-	static const unsigned int BIOMES_SIZE = 1024;
-#endif
+    static const int CHUNK_MIN_Y = 0;
+    static const int NUM_HEIGHTMAPS = 3;
 
     class Chunk
     {
     public:
 #if PROTOCOL_VERSION < 719
-        Chunk(const Dimension &dim = Dimension::Overworld);
+        Chunk(const int min_y_ = CHUNK_MIN_Y, const int height_ = CHUNK_HEIGHT, const Dimension &dim = Dimension::Overworld);
 #else
-        Chunk(const std::string& dim = "minecraft:overworld");
+        Chunk(const int min_y_ = CHUNK_MIN_Y, const int height_ = CHUNK_HEIGHT, const std::string& dim = "minecraft:overworld");
 #endif
         Chunk(const Chunk& c);
 
+        // Lowest block y in this chunk
+        const int GetMinY() const;
+        // Number of blocks along y, always a multiple of SECTION_HEIGHT
+        const int GetHeight() const;
+
         static const Position BlockCoordsToChunkCoords(const Position& pos);
 
 #if USE_GUI
@@ -40,14 +46,23 @@ namespace Botcraft
 #endif
 
 #if PROTOCOL_VERSION < 552
-        void LoadChunkData(const std::vector<unsigned char>& data, const int primary_bit_mask, const bool ground_up_continuous);
+        void LoadChunkData(const ProtocolCraft::ByteSlice& data, const int primary_bit_mask, const bool ground_up_continuous);
 #elif PROTOCOL_VERSION < 755
-        void LoadChunkData(const std::vector<unsigned char>& data, const int primary_bit_mask);
+        void LoadChunkData(const ProtocolCraft::ByteSlice& data, const int primary_bit_mask);
 #else
-        void LoadChunkData(const std::vector<unsigned char>& data, const std::vector<unsigned long long int>& primary_bit_mask);
+        void LoadChunkData(const ProtocolCraft::ByteSlice& data, const std::vector<unsigned long long int>& primary_bit_mask);
 #endif
         void LoadChunkBlockEntitiesData(const std::vector<ProtocolCraft::NBT>& block_entities);
 
+        // Y of the highest block of the column x, z (in chunk) matching
+        // the heightmap type, min_y - 1 if there is none. Heightmaps
+        // are computed locally (MotionBlocking is solid or fluid blocks,
+        // not vanilla's exact definition) when the chunk is loaded and
+        // updated each time a block is set
+        const int GetHighestBlock(const Heightmap type, const int x, const int z) const;
+
+        // Returned pointer is valid until the next
+        // modification of the corresponding section
         const Block *GetBlock(const Position &pos) const;
 #if PROTOCOL_VERSION < 347
         void SetBlock(const Position &pos, const unsigned int id, unsigned char metadata, const int model_id = -1);
@@ -55,20 +70,45 @@ namespace Botcraft
         void SetBlock(const Position &pos, const unsigned int id, const int model_id = -1);
 #endif
         void SetBlock(const Position& pos, const Block* block);
+        // Set multiple blocks in the section y (index starting at 0 for
+        // the one at min_y). positions are x << 8 | z << 4 | y in the
+        // section, as in the network data
+        void SetSectionBlocks(const int y, const std::vector<short>& positions, const std::vector<Block>& blocks);
 
         const unsigned char GetBlockLight(const Position &pos) const;
         void SetBlockLight(const Position &pos, const unsigned char v);
         const unsigned char GetSkyLight(const Position &pos) const;
         void SetSkyLight(const Position &pos, const unsigned char v);
+        // Replace the light of a whole section (y is the section
+        // index) with LIGHT_DATA_SIZE bytes in network format,
+        // or with 0 if data is nullptr
+        void LoadSectionLight(const int y, const unsigned char* data, const bool sky);
+        // Replace the light of all the sections with the one of
+        // other. Does nothing if other min_y or height is different
+        void CopyLight(const Chunk& other);
 #if PROTOCOL_VERSION < 719
         const Dimension GetDimension() const;
 #else
         const std::string& GetDimension() const;
 #endif
 
-        std::map<Position, std::shared_ptr<ProtocolCraft::NBT> >& GetBlockEntitiesData();
-        const std::map<Position, std::shared_ptr<ProtocolCraft::NBT> >& GetBlockEntitiesData() const;
+        const BlockEntityStore& GetBlockEntitiesData() const;
+
+        // Index of some selected blocks in each section, not updated
+        // by the other functions of this class (see Section::BuildIndex)
+        void BuildBlockIndex(const BlockPredicate* selector);
+        void UpdateBlockIndex(const Position& pos, const BlockPredicate& selector);
+        // Append to out the positions of the blocks of the section y
+        // matching predicate, with x and z in chunk, see Section::FindBlocks
+        void FindBlocks(const int y, const BlockPredicate& predicate, const BlockPredicate* selector, std::vector<Position>& out) const;
 
+        // Copy the blockstate ids and light of the blocks in [min, max]
+        // (x and z in chunk) to out[(y - min.y) * stride_y + (z - min.z) * stride_z + x - min.x],
+        // see Section::CopyRegion. Values of empty sections are not written
+        void CopyRegion(const Position& min, const Position& max, const size_t stride_z, const size_t stride_y,
+            unsigned int* ids, unsigned char* block_light, unsigned char* sky_light) const;
+
+        // y is the index of the section, starting at 0 for the one at min_y
         const bool HasSection(const int y) const;
         void AddSection(const int y);
 
@@ -85,17 +125,82 @@ namespace Botcraft
 		void SetBiome(const int x, const int y, const int z, const int new_biome);
 		void SetBiome(const int i, const int new_biome);
 #endif
-        std::shared_ptr<ProtocolCraft::NBT> GetBlockEntityData(const Position &pos);
-        void UpdateNeighbour(const std::shared_ptr<Chunk> neighbour, const Orientation direction);
+        // Biome at this position, resolved only once for each
+        // different biome of the chunk. nullptr if unknown
+#if PROTOCOL_VERSION < 552
+        const Biome* GetBiomePtr(const int x, const int z) const;
+#else
+        const Biome* GetBiomePtr(const int x, const int y, const int z) const;
+#endif
+        // pos is the position in the chunk, the returned data
+        // is shared with the chunk and must not be modified
+        std::shared_ptr<const ProtocolCraft::NBT> GetBlockEntityData(const Position &pos) const;
+        // Remove the data at pos if data is empty
+        void SetBlockEntityData(const Position& pos, const ProtocolCraft::NBT& data);
+
+        // Hash of the network data this chunk has been loaded
+        // from, 0 if unknown or if it has been modified since
+        const size_t GetDataHash() const;
+        void SetDataHash(const size_t hash);
+
+        // Approximate number of bytes used by this chunk (block
+        // entities NBT content is not counted). The value is only
+        // recomputed when calling UpdateMemoryUsage (all the chunk)
+        // or UpdateSectionMemoryUsage (only one section)
+        const size_t GetMemoryUsage() const;
+        void UpdateMemoryUsage();
+        // Bytes used by the section at index section_y
+        // (from the bottom of the chunk), 0 if not allocated
+        const size_t GetSectionMemoryUsage(const int section_y) const;
+        // Update the chunk usage after section_y has been
+        // modified, old_section_usage being its usage before
+        void UpdateSectionMemoryUsage(const int section_y, const size_t old_section_usage);
+
+        // Write/read the whole chunk content (except the dimension),
+        // used by the on disk chunk cache. Deserialize throws a
+        // std::runtime_error on bad data
+        void Serialize(ProtocolCraft::WriteContainer& container) const;
+        void Deserialize(ProtocolCraft::ReadIterator& iter, size_t& length);
+
+    private:
+        // Compute all the heightmaps from the sections
+        void ComputeHeightmaps();
+        // Update the heightmaps after the block at x, y, z (in chunk) changed
+        void UpdateHeightmaps(const int x, const int y, const int z);
+        // Section y, cloned first if it's shared with a copy of
+        // this chunk. Must be used before any section modification
+        Section& GetWritableSection(const int y);
+
+        struct BiomePaletteEntry
+        {
+            int id;
+            const Biome* biome;
+        };
+        // Palette entry of the biome cell i, nullptr if out of range
+        const BiomePaletteEntry* GetBiomeEntry(const int i) const;
+        void SetBiomeCell(const int i, const int id);
+        // Set num_biome_cells from the height and all the cells to biome 0
+        void ResetBiomes();
+        // Replace all the biomes, ids must have one value per cell
+        void LoadBiomes(const std::vector<int>& ids);
         
     private:
+        int min_y;
+        int height;
+        // Only sized up to the highest allocated section. Sections
+        // are shared between copies of a chunk (copy-on-write)
         std::vector<std::shared_ptr<Section> > sections;
-#if PROTOCOL_VERSION < 358
-        std::vector<unsigned char> biomes;
-#else
-        std::vector<int> biomes;
-#endif
-        std::map<Position, std::shared_ptr<ProtocolCraft::NBT> > block_entities_data;
+        // Biomes are stored as a palette of the different biomes of
+        // this chunk plus one palette index per cell (a cell is a
+        // column before 1.15 and a 4x4x4 cube after). Most chunks
+        // have only one biome, biome_indices is then empty
+        int num_biome_cells;
+        std::vector<BiomePaletteEntry> biome_palette;
+        std::vector<unsigned char> biome_indices;
+        BlockEntityStore block_entities_data;
+        // y - min_y + 1 of the highest matching block of each
+        // column (z * CHUNK_WIDTH + x), 0 if there is none
+        std::array<std::array<unsigned short, CHUNK_WIDTH * CHUNK_WIDTH>, NUM_HEIGHTMAPS> heightmaps;
 #if PROTOCOL_VERSION < 719
         Dimension dimension;
 #else
@@ -104,5 +209,7 @@ namespace Botcraft
 #if USE_GUI
         bool modified_since_last_rendered;
 #endif
+        size_t data_hash;
+        size_t memory_usage;
     };
 } // Botcraft
\ No newline at end of file
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <string>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <tuple>
+
+#include "botcraft/Game/Enums.hpp"
+
+namespace Botcraft
+{
+    class Chunk;
+
+    // On disk cache of chunks. Chunks are stored in region
+    // files of 32x32 chunks, one folder per dimension. Each
+    // chunk is saved as its palette sections (compressed if
+    // compression is enabled), so loading it back is much
+    // cheaper than decoding the network data. Region files
+    // are memory mapped when reading.
+    // All the functions are thread safe, the same cache can
+    // be used by multiple worlds, but a folder must not be
+    // used by two processes at the same time
+    class ChunkCache
+    {
+    public:
+        // folder_ is created if it doesn't exist, files are
+        // stored in a subfolder for the current protocol version
+        ChunkCache(const std::string& folder_);
+        ~ChunkCache();
+
+#if PROTOCOL_VERSION < 719
+        // Save the chunk, replacing any previous version
+        bool Save(const Dimension dim, const int x, const int z, const Chunk& chunk);
+        // Return nullptr if the chunk is not in the cache
+        std::shared_ptr<Chunk> Load(const Dimension dim, const int x, const int z);
+        // Hash of the network data the saved chunk was loaded
+        // from, 0 if unknown or if the chunk is not in the cache
+        const size_t GetDataHash(const Dimension dim, const int x, const int z);
+#else
+        // Save the chunk, replacing any previous version
+        bool Save(const std::string& dim, const int x, const int z, const Chunk& chunk);
+        // Return nullptr if the chunk is not in the cache
+        std::shared_ptr<Chunk> Load(const std::string& dim, const int x, const int z);
+        // Hash of the network data the saved chunk was loaded
+        // from, 0 if unknown or if the chunk is not in the cache
+        const size_t GetDataHash(const std::string& dim, const int x, const int z);
+#endif
+
+    private:
+        struct Region;
+
+        bool SaveImpl(const std::string& dim_name, const int x, const int z, const Chunk& chunk);
+        bool LoadImpl(const std::string& dim_name, const int x, const int z, Chunk& chunk);
+        const size_t GetDataHashImpl(const std::string& dim_name, const int x, const int z);
+
+        // Return nullptr if the region file doesn't exist and create is false
+        Region* GetRegion(const std::string& dim_name, const int region_x, const int region_z, const bool create);
+
+    private:
+        std::string folder;
+        std::mutex cache_mutex;
+        std::map<std::tuple<std::string, int, int>, std::unique_ptr<Region> > regions;
+    };
+} // Botcraft
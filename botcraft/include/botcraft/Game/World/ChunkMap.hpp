@@ -0,0 +1,70 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <utility>
+
+namespace Botcraft
+{
+    class Chunk;
+
+    // Open addressing (linear probing) hash map from chunk
+    // coordinates to chunks. Lookups only hash the packed
+    // coordinates and scan a few contiguous slots instead
+    // of walking a tree like std::map
+    class ChunkMap
+    {
+    public:
+        using value_type = std::pair<std::pair<int, int>, std::shared_ptr<Chunk> >;
+
+        // Iterate over all the chunks in the map
+        // (in no particular order)
+        class const_iterator
+        {
+        public:
+            const_iterator(const std::vector<value_type>& slots_, const size_t index_);
+
+            const value_type& operator*() const;
+            const value_type* operator->() const;
+            const_iterator& operator++();
+            const bool operator==(const const_iterator& other) const;
+            const bool operator!=(const const_iterator& other) const;
+
+        private:
+            void SkipEmpty();
+
+        private:
+            const std::vector<value_type>* slots;
+            size_t index;
+        };
+
+    public:
+        ChunkMap();
+
+        // Return the chunk at x, z or nullptr if not in the map
+        const std::shared_ptr<Chunk>& Get(const int x, const int z) const;
+        // Insert or replace the chunk at x, z, chunk must not be nullptr
+        void Set(const int x, const int z, const std::shared_ptr<Chunk>& chunk);
+        // Return false if there was no chunk at x, z
+        bool Erase(const int x, const int z);
+        void Clear();
+
+        const size_t size() const;
+        const bool empty() const;
+
+        const_iterator begin() const;
+        const_iterator end() const;
+
+    private:
+        static const size_t Hash(const int x, const int z);
+        // Index of the slot containing x, z or of the
+        // empty slot where it should be inserted
+        const size_t FindSlot(const int x, const int z) const;
+        void Grow();
+
+    private:
+        // Empty slots have a nullptr chunk
+        std::vector<value_type> slots;
+        size_t num_elements;
+    };
+} // Botcraft
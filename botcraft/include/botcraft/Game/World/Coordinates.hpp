@@ -0,0 +1,67 @@
+#pragma once
+
+#include "botcraft/Game/Vector3.hpp"
+
+namespace Botcraft
+{
+    //A chunk is 16*height*16, starting at min_y
+    //And a section is 16*16*16
+    static constexpr int CHUNK_WIDTH_BITS = 4;
+    static constexpr int SECTION_HEIGHT_BITS = 4;
+    static constexpr int CHUNK_WIDTH = 1 << CHUNK_WIDTH_BITS;
+    static constexpr int SECTION_HEIGHT = 1 << SECTION_HEIGHT_BITS;
+
+    // Integer only conversions between block coordinates and
+    // chunk/section coordinates. Unlike / and %, the shifts
+    // and masks round negative values down, so -1 is in the
+    // chunk -1, at the in-chunk coordinate 15
+    static_assert((-1 >> 1) == -1, "Coordinates conversion requires arithmetic right shift of signed integers");
+
+    // Chunk coordinate (x or z) containing the block coordinate
+    constexpr int ToChunkCoord(const int v)
+    {
+        return v >> CHUNK_WIDTH_BITS;
+    }
+
+    // Coordinate (x or z) of the block inside its chunk, in [0, CHUNK_WIDTH - 1]
+    constexpr int ToChunkLocalCoord(const int v)
+    {
+        return v & (CHUNK_WIDTH - 1);
+    }
+
+    // Section coordinate containing the block y
+    constexpr int ToSectionCoord(const int y)
+    {
+        return y >> SECTION_HEIGHT_BITS;
+    }
+
+    // Coordinate y of the block inside its section, in [0, SECTION_HEIGHT - 1]
+    constexpr int ToSectionLocalCoord(const int y)
+    {
+        return y & (SECTION_HEIGHT - 1);
+    }
+
+    // First block coordinate (x or z) of a chunk
+    constexpr int ChunkToBlockCoord(const int v)
+    {
+        return v * CHUNK_WIDTH;
+    }
+
+    // Index of a block in a section given its coordinates in the section
+    constexpr int ToSectionBlockIndex(const int x, const int y, const int z)
+    {
+        return (((y << CHUNK_WIDTH_BITS) | z) << CHUNK_WIDTH_BITS) | x;
+    }
+
+    // Chunk coordinates of a block position (y is set to 0)
+    inline Position ToChunkCoords(const Position& pos)
+    {
+        return Position(ToChunkCoord(pos.x), 0, ToChunkCoord(pos.z));
+    }
+
+    // Position of the block inside its chunk (y is unchanged)
+    inline Position ToChunkLocalPosition(const Position& pos)
+    {
+        return Position(ToChunkLocalCoord(pos.x), pos.y, ToChunkLocalCoord(pos.z));
+    }
+} // Botcraft
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <vector>
+#include <array>
 #include <map>
 #include <memory>
 
@@ -8,20 +9,113 @@
 
 namespace Botcraft
 {
+    // Light values are stored as in the network format,
+    // two 4 bits values per byte, in y, z, x order
+    static const int LIGHT_DATA_SIZE = CHUNK_WIDTH * CHUNK_WIDTH * SECTION_HEIGHT / 2;
+    using LightData = std::array<unsigned char, LIGHT_DATA_SIZE>;
+
+    // Blocks are stored as indices into a per-section
+    // palette of unique Block (blockstate + model),
+    // packed on 4, 8 or 16 bits depending on the
+    // palette size. Most sections only contain a few
+    // different blocks, so this is much lighter than
+    // storing one Block per voxel
     struct Section
     {
-        Section(const bool has_sky_light)
-        {
-            // +2 because we also store the neighbour section blocks
-            data_blocks = std::vector<Block>((CHUNK_WIDTH + 2) * (CHUNK_WIDTH + 2) * SECTION_HEIGHT);
-            block_light = std::vector<unsigned char>(CHUNK_WIDTH * CHUNK_WIDTH * SECTION_HEIGHT);
-            if (has_sky_light)
-            {
-                sky_light = std::vector<unsigned char>(CHUNK_WIDTH * CHUNK_WIDTH * SECTION_HEIGHT);
-            }
-        }
-        std::vector<Block> data_blocks;
-        std::vector<unsigned char> block_light;
-        std::vector<unsigned char> sky_light;
+        Section(const bool has_sky_light);
+
+        // Index of the block in the section storage. Blocks
+        // of the neighbour chunks are not stored in the section,
+        // they must be read from the world
+        static const int GetBlockIndex(const int x, const int y, const int z);
+
+        // Returned pointer points into the palette and is valid
+        // until the next modification of this section
+        const Block* GetBlock(const int index) const;
+        void SetBlock(const int index, const Block& block);
+
+        // Replace all the blocks of this section
+        // indices are CHUNK_WIDTH * CHUNK_WIDTH * SECTION_HEIGHT
+        // values in [0, blocks_palette.size()[, in y, z, x order
+        void LoadBlocks(const std::vector<Block>& blocks_palette, const unsigned short* indices);
+
+        const unsigned char GetBitsPerEntry() const;
+        const size_t GetPaletteSize() const;
+        // Approximate number of bytes used by this section.
+        // Light arrays shared with other sections are not counted
+        const size_t GetMemoryUsage() const;
+
+        // Light uses the same indices as the blocks
+        const unsigned char GetBlockLight(const int index) const;
+        void SetBlockLight(const int index, const unsigned char v);
+        const unsigned char GetSkyLight(const int index) const;
+        void SetSkyLight(const int index, const unsigned char v);
+        const bool HasSkyLight() const;
+
+        // Replace all the light values of this section with
+        // LIGHT_DATA_SIZE bytes in network format, or with 0
+        // if data is nullptr. Sections with only 0 or only 15
+        // share the same light arrays
+        void LoadBlockLight(const unsigned char* data);
+        void LoadSkyLight(const unsigned char* data);
+        // Use the same light values as other, the light
+        // arrays are shared until one of them is modified
+        void CopyLight(const Section& other);
+
+        // Optional index of the positions of some selected blocks,
+        // used to find them without looking at all the blocks. It's
+        // not updated by SetBlock/LoadBlocks, the owner must call
+        // BuildIndex/UpdateIndex after modifying the section.
+        // Air is never indexed, selector nullptr clears the index
+        void BuildIndex(const BlockPredicate* selector);
+        void UpdateIndex(const int index, const BlockPredicate& selector);
+        // Append to out the indices of the blocks matching predicate.
+        // If selector is the one used to build the index and selects
+        // all the palette entries matching predicate, only the indexed
+        // blocks are checked
+        void FindBlocks(const BlockPredicate& predicate, const BlockPredicate* selector, std::vector<int>& out) const;
+
+        // Copy the blockstate ids (id << 4 | metadata before 1.13) and
+        // the light of the blocks in [min, max] (section coordinates)
+        // to out[(y - min.y) * stride_y + (z - min.z) * stride_z + x - min.x].
+        // block_light and sky_light are skipped if nullptr
+        void CopyRegion(const Position& min, const Position& max, const size_t stride_z, const size_t stride_y,
+            unsigned int* ids, unsigned char* block_light, unsigned char* sky_light) const;
+
+        // Write/read the palette, packed indices and light
+        // of this section, used by the on disk chunk cache.
+        // Deserialize throws a std::runtime_error on bad data
+        void Serialize(ProtocolCraft::WriteContainer& container) const;
+        void Deserialize(ProtocolCraft::ReadIterator& iter, size_t& length);
+
+    private:
+        const unsigned short GetPaletteIndex(const int index) const;
+        void SetPaletteIndex(const int index, const unsigned short palette_index);
+        const unsigned short AddToPalette(const Block& block);
+
+        // Remove unused palette entries and remap the indices
+        void CompactPalette();
+        // Repack the indices with a new number of bits per entry
+        void ResizeStorage(const unsigned char new_bits_per_entry);
+
+        static void LoadLight(std::shared_ptr<LightData>& light, const unsigned char* data);
+        static void SetLight(std::shared_ptr<LightData>& light, const int index, const unsigned char v);
+        static void SerializeLight(const std::shared_ptr<LightData>& light, ProtocolCraft::WriteContainer& container);
+        static void DeserializeLight(std::shared_ptr<LightData>& light, ProtocolCraft::ReadIterator& iter, size_t& length);
+
+    private:
+        std::vector<Block> palette;
+        std::vector<unsigned char> data_blocks;
+        unsigned char bits_per_entry;
+        // One bit per block, set if it's selected by the index,
+        // so the index is updated in constant time
+        std::array<unsigned long long int, CHUNK_WIDTH * CHUNK_WIDTH * SECTION_HEIGHT / 64> indexed_blocks;
+
+        // Light arrays can be shared between sections (copies
+        // of this one or sections with uniform light) so they
+        // are copied before being modified if not unique.
+        // sky_light is nullptr if the dimension has no sky light
+        std::shared_ptr<LightData> block_light;
+        std::shared_ptr<LightData> sky_light;
     };
-} // Botcraft
\ No newline at end of file
+} // Botcraft
@@ -4,11 +4,16 @@
 #include <array>
 #include <memory>
 #include <mutex>
+#include <shared_mutex>
 #include <queue>
+#include <tuple>
+#include <atomic>
 
 #include "botcraft/Game/Vector3.hpp"
 #include "botcraft/Game/Enums.hpp"
 #include "botcraft/Game/World/Chunk.hpp"
+#include "botcraft/Game/World/ChunkMap.hpp"
+#include "botcraft/Game/World/WorldChangeFeed.hpp"
 
 #include "protocolCraft/Types/NBT/NBT.hpp"
 #include "protocolCraft/Handler.hpp"
@@ -18,9 +23,7 @@ namespace Botcraft
     class Block;
     class Blockstate;
     class AsyncHandler;
-
-    static const int WORLD_START_Y = 0;
-    static const int WORLD_END_Y = WORLD_START_Y + CHUNK_HEIGHT;
+    class ChunkCache;
 
     class World : public ProtocolCraft::Handler
     {
@@ -28,7 +31,9 @@ namespace Botcraft
         // if is_shared_ is true, this world
         // can be shared by multiple bot instance, saving memory
         // when they are in the same area, but slowing things down
-        // if too many share the same instance
+        // if too many share the same instance. Chunks received
+        // by multiple bots are only loaded once if they didn't
+        // change in between
         //
         // if async_handler_ is true, all packets will be copied
         // and processed on another specific thread instead of
@@ -39,7 +44,9 @@ namespace Botcraft
         World(const bool is_shared_, const bool async_handler_ = false);
         ~World();
 
-        std::mutex& GetMutex();
+        // Functions modifying the world need an exclusive lock
+        // on this mutex, const ones only need a shared lock
+        std::shared_mutex& GetMutex();
         const bool IsShared() const;
 
         ProtocolCraft::Handler* GetAsyncHandler();
@@ -57,13 +64,13 @@ namespace Botcraft
 #endif
 
 #if PROTOCOL_VERSION < 552
-        bool LoadDataInChunk(const int x, const int z, const std::vector<unsigned char>& data,
+        bool LoadDataInChunk(const int x, const int z, const ProtocolCraft::ByteSlice& data,
             const int primary_bit_mask, const bool ground_up_continuous);
 #elif PROTOCOL_VERSION < 755
-        bool LoadDataInChunk(const int x, const int z, const std::vector<unsigned char>& data,
+        bool LoadDataInChunk(const int x, const int z, const ProtocolCraft::ByteSlice& data,
             const int primary_bit_mask);
 #else
-        bool LoadDataInChunk(const int x, const int z, const std::vector<unsigned char>& data,
+        bool LoadDataInChunk(const int x, const int z, const ProtocolCraft::ByteSlice& data,
             const std::vector<unsigned long long int>& primary_bit_mask);
 #endif
         bool LoadBlockEntityDataInChunk(const int x, const int z, const std::vector<ProtocolCraft::NBT>& block_entities);
@@ -71,25 +78,110 @@ namespace Botcraft
         bool LoadBiomesInChunk(const int x, const int z, const std::vector<int>& biomes);
 #endif
 
-        // Update the neighbour blocks of this chunk and the
-        // one in the specified direction, if direction is 0,0,0
-        // then update all neighbours chunks
+        // Mark the neighbour chunk in the specified direction as
+        // modified for the renderer, if direction is 0,0,0 then
+        // mark all the neighbour chunks
         void UpdateChunk(const int x, const int z, const Position& pos = Position());
 
+        // Get an immutable version of the chunk, that can be
+        // read without locking the world. This is cheap as the
+        // chunk is only copied if the world modifies it while
+        // the returned pointer is still alive
         const std::shared_ptr<const Chunk> GetChunkCopy(const int x, const int z);
 
+        // Set a disk cache for this world's chunks (nullptr to disable).
+        // Forgotten chunks and chunks of the previous dimension are
+        // saved in it, and chunks received again with the exact same
+        // data are loaded from it instead of decoding the network data
+        void SetChunkCache(const std::shared_ptr<ChunkCache>& cache);
+        // Save all the currently loaded chunks in the cache, can be
+        // called regularly to be able to warm start after a crash
+        void SaveChunksToCache();
+        // Load a chunk of the current dimension from the disk cache,
+        // even if it's not loaded in the world. nullptr if there is
+        // no cache or if this chunk is not in it
+        const std::shared_ptr<const Chunk> GetChunkFromCache(const int x, const int z) const;
+
+        // Get a feed of all the block changes and chunk
+        // loads/unloads happening in this world from now on.
+        // The subscription stops when the returned pointer is
+        // destroyed. Each subscription must be polled by only
+        // one thread, but doesn't need the world to be locked
+        std::shared_ptr<WorldChangeSubscription> SubscribeToChanges(const size_t capacity = 4096);
+
+        // Limit the approximate memory used by the chunks of this
+        // world, in bytes (0, the default, for no limit). When a
+        // received chunk puts the world over budget, the chunks
+        // the farthest from the view centers are removed until the
+        // usage is under 90% of the budget. Chunks in view distance
+        // are never removed, as the server would not send them again,
+        // so the usage can stay over a budget too small for the view
+        // distance. Removed chunks are saved in the chunk cache if
+        // there is one
+        void SetMemoryBudget(const size_t bytes);
+        // Approximate memory currently used by the chunks,
+        // and highest value since this world creation.
+        // Don't need the world to be locked
+        const size_t GetMemoryUsage() const;
+        const size_t GetPeakMemoryUsage() const;
+        // Chunk the player of client is in, used to know which chunks
+        // can be removed when over the memory budget. Should be set when
+        // the player changes chunk (BaseClient does it). In a shared world,
+        // chunks around the centers of all the clients are kept. client
+        // is only used as a key to identify the caller
+        void SetViewCenter(const void* client, const int chunk_x, const int chunk_z);
+        // Stop protecting the chunks around client view center,
+        // should be called when client disconnects
+        void RemoveViewCenter(const void* client);
+
 #if PROTOCOL_VERSION < 347
         bool SetBlock(const Position &pos, const unsigned int id, unsigned char metadata, const int model_id = -1);
 #else
         bool SetBlock(const Position &pos, const unsigned int id, const int model_id = -1);
 #endif
+        // Set multiple blocks of the same section, locking the world
+        // and looking for the chunk only once. section_y is the
+        // section coordinate (y / SECTION_HEIGHT), positions are
+        // x << 8 | z << 4 | y in the section and states the network
+        // blockstate ids (id << 4 | metadata before 1.13)
+        bool ApplySectionUpdates(const int chunk_x, const int section_y, const int chunk_z,
+            const std::vector<short>& positions, const std::vector<int>& states);
+
+        // Keep an index of the positions of the blocks matching
+        // selector in all the chunks, to speed up FindNearest.
+        // An empty selector removes the index
+        void SetIndexedBlocks(const BlockPredicate& selector);
+        // Find the closest block matching predicate at most radius
+        // blocks away from pos. Only the sections with a block matching
+        // predicate in their palette are searched, and only their indexed
+        // blocks if all these palette entries are selected by the index.
+        // Air in empty sections is never found.
+        // Return false if no block is found
+        const bool FindNearest(const Position& pos, const BlockPredicate& predicate, const int radius, Position& out_pos) const;
+
+        // Copy the blockstate ids (id << 4 | metadata before 1.13) of all
+        // the blocks in [min, max] into ids, in y, z, x order: the id of x, y, z
+        // is at ((y - min.y) * size_z + z - min.z) * size_x + x - min.x.
+        // ids must have room for size_x * size_y * size_z values. block_light
+        // and sky_light are filled the same way if not nullptr. Blocks in
+        // unloaded chunks are set to 0. The world is locked only once
+        // so it must not be already locked by the caller.
+        // Return false if min is not lower than max on all axis
+        bool SnapshotRegion(const Position& min, const Position& max, unsigned int* ids,
+            unsigned char* block_light = nullptr, unsigned char* sky_light = nullptr) const;
+
         //Get the block at a given position
-        const Block* GetBlock(const Position& pos);
+        const Block* GetBlock(const Position& pos) const;
+        // Y of the highest block of the x, z column matching the
+        // heightmap type, GetMinY() - 1 if there is none or if the
+        // chunk is not loaded
+        const int GetHighestBlock(const Heightmap type, const int x, const int z) const;
+        const int GetHighestSolid(const int x, const int z) const;
         const bool IsLoaded(const Position& pos) const;
 
         bool SetBlockEntityData(const Position &pos, const ProtocolCraft::NBT& data);
         // Get the block entity data at a given position
-        std::shared_ptr<ProtocolCraft::NBT> GetBlockEntityData(const Position& pos);
+        std::shared_ptr<const ProtocolCraft::NBT> GetBlockEntityData(const Position& pos) const;
 
 #if PROTOCOL_VERSION < 358
         bool SetBiome(const int x, const int z, const unsigned char biome);
@@ -100,10 +192,13 @@ namespace Botcraft
 #endif
 
 #if PROTOCOL_VERSION < 358
-        const unsigned char GetBiome(const Position & pos);
+        const unsigned char GetBiome(const Position & pos) const;
 #else
-        const int GetBiome(const Position& pos);
+        const int GetBiome(const Position& pos) const;
 #endif
+        // Same as GetBiome, but without the AssetsManager
+        // lookup, nullptr if unknown or not loaded
+        const Biome* GetBiomePtr(const Position& pos) const;
 
         bool SetSkyLight(const Position &pos, const unsigned char skylight);
         bool SetBlockLight(const Position &pos, const unsigned char blocklight);
@@ -116,13 +211,13 @@ namespace Botcraft
             const std::vector<unsigned long long int>& light_mask, const std::vector<unsigned long long int>& empty_light_mask, 
             const std::vector<std::vector<char> >& data, const bool sky);
 #endif
-        const unsigned char GetSkyLight(const Position& pos);
-        const unsigned char GetBlockLight(const Position& pos);
+        const unsigned char GetSkyLight(const Position& pos) const;
+        const unsigned char GetBlockLight(const Position& pos) const;
 
 #if PROTOCOL_VERSION < 719
-        const Dimension GetDimension(const int x, const int z);
+        const Dimension GetDimension(const int x, const int z) const;
 #else
-        const std::string GetDimension(const int x, const int z);
+        const std::string GetDimension(const int x, const int z) const;
 #endif
 
         /**
@@ -136,13 +231,46 @@ namespace Botcraft
         * @return the blockstate of the hit cube (or null)
         */
         std::shared_ptr<Blockstate> Raycast(const Vector3<double> &origin, const Vector3<double> &direction,
-            const float max_radius, Position &out_pos, Position &out_normal);
+            const float max_radius, Position &out_pos, Position &out_normal) const;
 
         // Get the list of chunks
-        const std::map<std::pair<int, int>, std::shared_ptr<Chunk> >& GetAllChunks() const;
+        const ChunkMap& GetAllChunks() const;
+
+        // Lowest block y and number of blocks along y
+        // in the current dimension
+        const int GetMinY() const;
+        const int GetHeight() const;
 
     private:
-        std::shared_ptr<Chunk> GetChunk(const int x, const int z);
+        // Get the chunk at x, z, copying it first if for_writing
+        // and it's still referenced outside of the world
+        std::shared_ptr<Chunk> GetChunk(const int x, const int z, const bool for_writing = true);
+        // Get the chunk at x, z without modifying the world.
+        // Pointer is valid as long as the lock is held
+        const Chunk* GetChunkForReading(const int x, const int z) const;
+#if PROTOCOL_VERSION > 754
+        // Read min_y and height from the dimension type
+        // sent by the server on login/respawn
+        void SetCurrentDimensionHeight(const ProtocolCraft::NBT& dimension_type);
+#endif
+        // Send changes to all the subscribers, world must be locked
+        void PublishChanges(const std::vector<WorldChange>& changes);
+        // Recompute all the memory used by the chunk at x, z,
+        // world must be locked
+        void UpdateChunkMemoryUsage(const int x, const int z);
+        // Faster version when only one section of chunk has been
+        // modified, old_section_usage being its usage before
+        void UpdateSectionMemoryUsage(Chunk& chunk, const int section_y, const size_t old_section_usage);
+        // Put chunk (fully loaded, not in the world yet) at x, z in place of
+        // the current one, keeping its light, world must be locked
+        void ReplaceChunk(const int x, const int z, const std::shared_ptr<Chunk>& chunk);
+        // Remove the chunks out of view distance, farthest first, if
+        // over budget, world must be locked. Removed chunks are returned
+        // so they can be saved in the cache once the world is unlocked
+        std::vector<std::tuple<int, int, std::shared_ptr<Chunk> > > EvictChunks();
+        // Save chunks removed from the world in cache (if not nullptr),
+        // world must NOT be locked
+        static void SaveRemovedChunks(const std::shared_ptr<ChunkCache>& cache, const std::vector<std::tuple<int, int, std::shared_ptr<Chunk> > >& chunks);
 
     protected:
         virtual void Handle(ProtocolCraft::ClientboundLoginPacket& msg) override;
@@ -155,21 +283,56 @@ namespace Botcraft
         virtual void Handle(ProtocolCraft::ClientboundLightUpdatePacket& msg) override;
 #endif
         virtual void Handle(ProtocolCraft::ClientboundBlockEntityDataPacket& msg) override;
+#if PROTOCOL_VERSION > 471
+        virtual void Handle(ProtocolCraft::ClientboundSetChunkCacheCenterPacket& msg) override;
+        virtual void Handle(ProtocolCraft::ClientboundSetChunkCacheRadiusPacket& msg) override;
+#endif
 
     private:
+        // Only used when modifying the world, reading
+        // functions use a thread local cache instead
         int cached_x;
         int cached_z;
-        std::mutex world_mutex;
         std::shared_ptr<Chunk> cached;
+        mutable std::shared_mutex world_mutex;
+
+        // Unique id of this world, and counter incremented each time a chunk
+        // is added/removed/replaced, used to invalidate reading caches
+        const unsigned long long int world_id;
+        unsigned long long int terrain_version;
 
-        std::map<std::pair<int, int>, std::shared_ptr<Chunk> > terrain;
+        ChunkMap terrain;
+        // Chunks given by GetChunkCopy, that must be
+        // copied before being modified
+        std::map<std::pair<int, int>, std::weak_ptr<const Chunk> > chunk_snapshots;
 
         bool is_shared;
+        std::shared_ptr<ChunkCache> chunk_cache;
+        std::vector<std::weak_ptr<WorldChangeSubscription> > change_subscriptions;
+
+        size_t memory_budget;
+        // Only modified with the world locked, but can be read without
+        std::atomic<size_t> memory_usage;
+        std::atomic<size_t> peak_memory_usage;
+        // Chunks at most view_distance + 1 chunks away from one
+        // of the clients view centers or from the server one are
+        // never evicted. If the server didn't send a center, the
+        // first received chunk is used
+        std::map<const void*, std::pair<int, int> > view_centers;
+        bool has_view_center;
+        int view_center_x;
+        int view_center_z;
+        int view_distance;
+        BlockPredicate block_index_selector;
+        // Incremented each time block_index_selector is changed
+        unsigned long long int block_index_selector_version;
 #if PROTOCOL_VERSION < 719
         Dimension current_dimension;
 #else
         std::string current_dimension;
 #endif
+        int current_min_y;
+        int current_height;
         std::unique_ptr<AsyncHandler> async_handler;
     };
 } // Botcraft
\ No newline at end of file
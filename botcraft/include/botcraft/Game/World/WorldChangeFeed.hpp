@@ -0,0 +1,67 @@
+#pragma once
+
+#include <vector>
+#include <atomic>
+
+#include "botcraft/Game/Vector3.hpp"
+
+namespace Botcraft
+{
+    class World;
+
+    enum class WorldChangeType
+    {
+        BlockChanged,
+        ChunkLoaded,
+        ChunkUnloaded
+    };
+
+    struct WorldChange
+    {
+        WorldChangeType type;
+        // Block position for BlockChanged,
+        // chunk coordinates (x, 0, z) otherwise
+        Position pos;
+        // Blockstate ids (id << 4 | metadata before 1.13),
+        // only set for BlockChanged
+        unsigned int old_state;
+        unsigned int new_state;
+    };
+
+    // Changes published by a World to one subscriber. Changes
+    // are pushed by the world (always with its mutex locked) and
+    // read by one consumer thread, through a lock-free ring buffer,
+    // so reading them never blocks the world.
+    // If the consumer doesn't read fast enough and the buffer is
+    // full, new changes are dropped and the next Poll returns false,
+    // the consumer should then rescan what it needs in the world
+    class WorldChangeSubscription
+    {
+    public:
+        // capacity_ is rounded up to a power of 2
+        WorldChangeSubscription(const size_t capacity_);
+
+        // Append all the pending changes to out.
+        // Return false if some changes were dropped
+        // since the last call
+        bool Poll(std::vector<WorldChange>& out);
+
+        const size_t GetCapacity() const;
+
+    private:
+        friend class World;
+
+        // Push all the changes or none of them if there
+        // is not enough space. Only one thread can push
+        // at the same time
+        bool Push(const std::vector<WorldChange>& changes);
+
+    private:
+        std::vector<WorldChange> buffer;
+        size_t mask;
+        // Monotonic counters, index in buffer is counter & mask
+        std::atomic<size_t> head;
+        std::atomic<size_t> tail;
+        std::atomic<bool> overflow;
+    };
+} // Botcraft
@@ -4,6 +4,7 @@
 #include "protocolCraft/enums.hpp"
 
 #include <vector>
+#include <memory>
 #include <queue>
 #include <thread>
 #include <mutex>
@@ -13,11 +14,20 @@ namespace Botcraft
 {
 	class TCP_Com;
 	class Authentifier;
+	class NetworkRuntime;
+#ifdef USE_COMPRESSION
+	class Decompressor;
+#endif
 
 	class NetworkManager : public ProtocolCraft::Handler
 	{
 	public:
-		NetworkManager(const std::string& address, const std::string& login, const std::string& password, const std::string& launcher_accounts_path);
+		// If use_shared_runtime is true, the connection and the packets processing
+		// run on the threads of a runtime shared by all the network managers of the
+		// process instead of two dedicated threads. Packets of one connection are
+		// still processed one at a time and in order
+		NetworkManager(const std::string& address, const std::string& login, const std::string& password, const std::string& launcher_accounts_path,
+			const bool use_shared_runtime = false);
 		// Used to create a dummy network manager that does not fire any message
 		// but is always in constant_connection_state
 		NetworkManager(const ProtocolCraft::ConnectionState constant_connection_state);
@@ -25,13 +35,27 @@ namespace Botcraft
 
 		void AddHandler(ProtocolCraft::Handler* h);
 		void Send(const std::shared_ptr<ProtocolCraft::Message> msg);
+		// If true, packets sent in Play state are queued and only sent
+		// together when Flush is called (typically once per tick)
+		void SetBatchWrites(const bool b);
+		void Flush();
 		const ProtocolCraft::ConnectionState GetConnectionState() const;
 		const std::string& GetMyName() const;
 
+		// Number of threads of the shared runtime, must be called
+		// before the first network manager using it is created.
+		// 0 (default) to use the number of cores
+		static void SetSharedRuntimeThreadCount(const unsigned int num_threads);
+
 	private:
 		void WaitForNewPackets();
-		void ProcessPacket(const std::vector<unsigned char>& packet);
-		void OnNewRawData(const std::vector<unsigned char>& packet);
+		// Process all the queued packets, on the shared runtime
+		void ProcessQueuedPackets();
+		void ProcessRawPacket(const std::shared_ptr<const std::vector<unsigned char> >& buffer, const size_t offset, const size_t size);
+		// Messages are read directly from packet, from offset to offset + size.
+		// Some of them (chunk data) can keep a reference on it instead of copying it
+		void ProcessPacket(const std::shared_ptr<const std::vector<unsigned char> >& packet, const size_t offset, const size_t size);
+		void OnNewRawData(const std::shared_ptr<const std::vector<unsigned char> >& buffer, const size_t offset, const size_t size);
 
 
 		virtual void Handle(ProtocolCraft::Message& msg) override;
@@ -48,13 +72,31 @@ namespace Botcraft
 		ProtocolCraft::ConnectionState state;
 
 		std::thread m_thread_process;//Thread running to process incoming packets without blocking com
+		// Used instead of m_thread_process if not nullptr
+		std::shared_ptr<NetworkRuntime> runtime;
+		// True if ProcessQueuedPackets has been posted to the
+		// runtime and has not finished yet
+		bool processing_scheduled;
 
-		std::queue<std::vector<unsigned char> > packets_to_process;
+		// Received packet, as a slice of one of TCP_Com read buffers
+		struct RawPacket
+		{
+			std::shared_ptr<const std::vector<unsigned char> > buffer;
+			size_t offset;
+			size_t size;
+		};
+		std::queue<RawPacket> packets_to_process;
 		std::mutex mutex_process;
 		std::condition_variable process_condition;
 		int compression;
+#ifdef USE_COMPRESSION
+		// Only used by the packet processing, which
+		// processes one packet at a time
+		std::unique_ptr<Decompressor> decompressor;
+#endif
 
 		std::mutex mutex_send;
+		bool batch_writes;
 
 		std::string name;
 
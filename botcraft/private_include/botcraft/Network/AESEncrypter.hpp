@@ -4,6 +4,7 @@
 
 #include <vector>
 #include <memory>
+#include <cstddef>
 
 typedef struct evp_cipher_ctx_st EVP_CIPHER_CTX;
 
@@ -18,6 +19,10 @@ namespace Botcraft
             std::vector<unsigned char>& raw_shared_secret, std::vector<unsigned char>& encrypted_token, std::vector<unsigned char>& encrypted_shared_secret);
         std::vector<unsigned char> Encrypt(const std::vector<unsigned char>& in);
         std::vector<unsigned char> Decrypt(const std::vector<unsigned char>& in);
+        // Encrypt/decrypt size bytes of data in place. AES-CFB8 is
+        // a stream cipher, so the output has the same size as the input
+        void Encrypt(unsigned char* data, const size_t size);
+        void Decrypt(unsigned char* data, const size_t size);
 
     private:
         EVP_CIPHER_CTX* encryption_context;
@@ -1,11 +1,46 @@
 #pragma once
 
 #include <vector>
+#include <cstddef>
+
+#ifdef USE_COMPRESSION
+#if USE_LIBDEFLATE
+struct libdeflate_decompressor;
+#else
+struct z_stream_s;
+#endif
+#endif
 
 namespace Botcraft
 {
 #ifdef USE_COMPRESSION
     std::vector<unsigned char> Compress(const std::vector<unsigned char> &raw, const int &start = 0, const int &size = -1);
     std::vector<unsigned char> Decompress(const std::vector<unsigned char> &compressed, const int &start = 0, const int &size = -1);
+    // Compress size bytes from data and append them to out
+    void Compress(const unsigned char* data, const size_t size, std::vector<unsigned char>& out);
+
+    // Decompress packets with the same context instead of creating
+    // a new one for each of them. Uses libdeflate if botcraft is
+    // compiled with USE_LIBDEFLATE, zlib otherwise.
+    // Not thread safe, use one per connection
+    class Decompressor
+    {
+    public:
+        Decompressor();
+        ~Decompressor();
+
+        // Decompress size bytes from data into out, which is resized to
+        // uncompressed_size first (the size sent in the packet header).
+        // Throws a std::runtime_error if the data are not valid or
+        // don't decompress to exactly uncompressed_size bytes
+        void Decompress(const unsigned char* data, const size_t size, const size_t uncompressed_size, std::vector<unsigned char>& out);
+
+    private:
+#if USE_LIBDEFLATE
+        libdeflate_decompressor* decompressor;
+#else
+        z_stream_s* stream;
+#endif
+    };
 #endif
 } // Botcraft
\ No newline at end of file
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <memory>
+#include <asio.hpp>
+
+namespace Botcraft
+{
+    // One io_context run by a pool of threads, that can be shared
+    // by all the connections of the process instead of having two
+    // threads per connection. Connections using it must serialize
+    // their handlers (with a strand) as they can run on any thread
+    class NetworkRuntime
+    {
+    public:
+        NetworkRuntime(const unsigned int num_threads);
+        ~NetworkRuntime();
+
+        // Get the process-wide runtime, created on first use and
+        // destroyed when no connection uses it anymore
+        static std::shared_ptr<NetworkRuntime> GetShared();
+        // Number of threads of the shared runtime, only used when
+        // it's created. 0 (default) to use the number of cores
+        static void SetSharedThreadCount(const unsigned int num_threads);
+
+        asio::io_context& GetContext();
+        const unsigned int GetThreadCount() const;
+
+    private:
+        asio::io_context io_context;
+        // Keep the threads running even when there is nothing to do
+        asio::executor_work_guard<asio::io_context::executor_type> work_guard;
+        std::vector<std::thread> threads;
+    };
+} // Botcraft
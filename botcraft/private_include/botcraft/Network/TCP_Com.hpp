@@ -1,7 +1,10 @@
 #pragma once
 
-#include <deque>
+#include <vector>
 #include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
 #include <asio.hpp>
 
 namespace Botcraft
@@ -9,17 +12,34 @@ namespace Botcraft
 #ifdef USE_ENCRYPTION
     class AESEncrypter;
 #endif
+    class NetworkRuntime;
 
     class TCP_Com
     {
     public:
+        // callback is called for each received packet with the buffer
+        // containing it, the packet offset in the buffer and its size.
+        // The buffer is never modified in this range afterwards, so the
+        // packet can be read later without copying it. Keeping a packet
+        // (or a slice of it) alive keeps the whole receive buffer (at
+        // least 64 KB) alive, so copy the data that must be kept long.
+        // If runtime_ is not nullptr, the connection uses its threads
+        // instead of creating its own, and callback can be called from
+        // any of them (but never concurrently for the same connection)
         TCP_Com(const std::string &address,
-            std::function<void(const std::vector<unsigned char>&)> callback);
+            std::function<void(const std::shared_ptr<const std::vector<unsigned char> >&, const size_t, const size_t)> callback,
+            const std::shared_ptr<NetworkRuntime>& runtime_ = nullptr);
         ~TCP_Com();
 
         void close();
 
-        void SendPacket(const std::vector<unsigned char> &msg);
+        // Queue msg to be sent. If flush is false, msg is only sent with
+        // the next packet sent with flush set to true or when Flush is
+        // called (or when enough data are queued). All the packets queued
+        // at the same time are sent with one write
+        void SendPacket(std::vector<unsigned char>&& msg, const bool flush = true);
+        // Send all the queued packets
+        void Flush();
 #ifdef USE_ENCRYPTION
         void SetEncrypter(const std::shared_ptr<AESEncrypter> encrypter_);
 #endif
@@ -33,7 +53,15 @@ namespace Botcraft
 
         void handle_read(const asio::error_code& error, std::size_t bytes_transferred);
 
-        void do_write(const std::vector<unsigned char> &msg);
+        // Make sure there is enough room after read_end for the
+        // next read, moving the incomplete packet at read_start
+        // to the beginning of a buffer if needed
+        void PrepareReadBuffer();
+        void do_read();
+
+        // Start writing all the queued packets if a flush has
+        // been requested and no write is in progress
+        void do_write();
 
         void handle_write(const asio::error_code& error);
 
@@ -41,19 +69,61 @@ namespace Botcraft
 
         void SetIPAndPortFromAddress(const std::string& address);
 
+        // Wrap a completion handler so it's executed in the strand
+        // and the destructor knows when it has been executed
+        template <typename Handler>
+        auto Track(Handler handler);
+        void OperationDone();
+
 
     private:
-        // io_service must be declared before socket
-        asio::io_service io_service;
+        // Shared runtime used by this connection, nullptr
+        // if it has its own io_context and thread
+        std::shared_ptr<NetworkRuntime> runtime;
+        std::unique_ptr<asio::io_context> own_io_context;
+        // io_context must be declared before strand and socket
+        asio::io_context& io_context;
+        // All the handlers of this connection go through the strand,
+        // so they never run concurrently, even on the shared runtime
+        asio::strand<asio::io_context::executor_type> strand;
         asio::ip::tcp::socket socket;
 
         std::thread thread_com;
 
-        std::array<unsigned char, 512> read_msg;
-        std::vector<unsigned char> input_msg;
-        std::deque<std::vector<unsigned char> > output_msg;
-
-        std::function<void(const std::vector<unsigned char>&)> NewPacketCallback;
+        // Async operations of this connection not completed yet,
+        // the destructor waits for them before returning
+        std::atomic<int> pending_operations;
+        std::mutex mutex_operations;
+        std::condition_variable operations_condition;
+
+        // Data are received directly in read_buffer and packets are
+        // given to the callback as slices of it. When the end is reached
+        // the incomplete packet is moved to a new buffer, the previous one
+        // stays alive as long as some of its packets are still referenced.
+        // If none is, the buffer is reused instead
+        std::shared_ptr<std::vector<unsigned char> > read_buffer;
+        // Start of the first incomplete packet and end of the received data
+        size_t read_start;
+        size_t read_end;
+
+        // Packet waiting to be sent, with its length written
+        // separately so data don't have to be moved to insert it
+        struct OutputFrame
+        {
+            unsigned char header[5];
+            size_t header_size;
+            std::vector<unsigned char> data;
+        };
+        // Packets queued but not sent yet, protected by mutex_output
+        std::vector<OutputFrame> queued_output;
+        size_t queued_output_size;
+        bool flush_requested;
+        // Packets of the current write, only used in the strand
+        std::vector<OutputFrame> writing_output;
+        std::vector<asio::const_buffer> write_buffers;
+        bool write_in_progress;
+
+        std::function<void(const std::shared_ptr<const std::vector<unsigned char> >&, const size_t, const size_t)> NewPacketCallback;
         std::mutex mutex_output;
 
         std::string ip;
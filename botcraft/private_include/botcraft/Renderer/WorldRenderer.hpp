@@ -5,6 +5,7 @@
 #include <glm/glm.hpp>
 
 #include <unordered_map>
+#include <array>
 #include <mutex>
 #include <memory>
 #include <vector>
@@ -45,7 +46,10 @@ namespace Botcraft
             void UpdateViewMatrix();
             void SetCameraProjection(const glm::mat4& proj);
             void UpdateFaces();
-            void UpdateChunk(const int x_, const int z_, const std::shared_ptr<const Botcraft::Chunk> chunk);
+            // neighbour_chunks are the chunks at x - 1, x + 1, z - 1 and z + 1
+            // (in this order), used to check the faces on the chunk borders
+            void UpdateChunk(const int x_, const int z_, const std::shared_ptr<const Botcraft::Chunk> chunk,
+                const std::array<std::shared_ptr<const Botcraft::Chunk>, 4>& neighbour_chunks);
             void UseAtlasTextureGL();
             void ClearFaces();
 
@@ -66,7 +70,7 @@ namespace Botcraft
                 const std::vector<unsigned int>& texture_multipliers_);
 
             // Returns the color modifier (for redstone/leaves/water etc...)
-            const std::vector<unsigned int> GetColorModifier(const int y, const std::shared_ptr<Biome> biome, const std::shared_ptr<Blockstate> blockstate, const std::vector<bool>& use_tintindex) const;
+            const std::vector<unsigned int> GetColorModifier(const int y, const Biome* biome, const std::shared_ptr<Blockstate> blockstate, const std::vector<bool>& use_tintindex) const;
 
             // Returns the distance from the center of the chunk to the camera
             const float DistanceToCamera(const Position& chunk) const;
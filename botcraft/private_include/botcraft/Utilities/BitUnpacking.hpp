@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstddef>
+
+namespace Botcraft
+{
+    // Convert count big endian 64 bits values
+    // (as sent on the network) to host order
+    void BigEndianLongsToHost(const unsigned char* src, const size_t count, unsigned long long int* dst);
+
+    /**
+    * Unpack num_entries values of bits_per_entry bits stored in a compacted long array
+    *
+    * @param[in] data the long array, in host order
+    * @param[in] data_size number of longs in data
+    * @param[in] bits_per_entry number of bits of each value, must be in [1, 16]
+    * @param[in] spanning if true, values can span across two longs (protocol < 713),
+    *            otherwise the remaining bits of each long are padding
+    * @param[in] num_entries number of values to unpack
+    * @param[out] out the unpacked values, must have room for num_entries values
+    * @return false if data is too small to contain num_entries values, true otherwise
+    */
+    const bool UnpackBits(const unsigned long long int* data, const size_t data_size,
+        const unsigned char bits_per_entry, const bool spanning,
+        const size_t num_entries, unsigned short* out);
+} // Botcraft
@@ -21,6 +21,7 @@ namespace Botcraft
     {
         std::cout << "Loading blocks from file..." << std::endl;
         LoadBlocksFile();
+        FlattenBlockstates();
         std::cout << "Done!" << std::endl;
         std::cout << "Loading biomes from file..." << std::endl;
         LoadBiomesFile();
@@ -42,6 +43,45 @@ namespace Botcraft
         return blockstates;
     }
 
+#if PROTOCOL_VERSION < 347
+    const std::shared_ptr<Blockstate>& AssetsManager::GetBlockstate(const unsigned int id, const unsigned char metadata) const
+    {
+        const unsigned int global_id = Blockstate::IdMetadataToId(id, metadata);
+#else
+    const std::shared_ptr<Blockstate>& AssetsManager::GetBlockstate(const unsigned int id) const
+    {
+        const unsigned int global_id = id;
+#endif
+        if (global_id < flat_blockstates.size())
+        {
+            return flat_blockstates[global_id];
+        }
+
+#if PROTOCOL_VERSION < 347
+        return blockstates.at(-1).at(0);
+#else
+        return blockstates.at(-1);
+#endif
+    }
+
+#if PROTOCOL_VERSION < 347
+    const BlockstateProperties& AssetsManager::GetBlockstateProperties(const unsigned int id, const unsigned char metadata) const
+    {
+        const unsigned int global_id = Blockstate::IdMetadataToId(id, metadata);
+#else
+    const BlockstateProperties& AssetsManager::GetBlockstateProperties(const unsigned int id) const
+    {
+        const unsigned int global_id = id;
+#endif
+        if (global_id < flat_blockstates.size())
+        {
+            return flat_blockstates_properties[global_id];
+        }
+
+        // The default blockstate properties are stored after all the valid ones
+        return flat_blockstates_properties.back();
+    }
+
 #if PROTOCOL_VERSION < 358
     const std::map<unsigned char, std::shared_ptr<Biome> >& AssetsManager::Biomes() const
 #else
@@ -531,6 +571,47 @@ namespace Botcraft
 #endif
     }
 
+    void AssetsManager::FlattenBlockstates()
+    {
+#if PROTOCOL_VERSION < 347
+        const std::shared_ptr<Blockstate> default_blockstate = blockstates.at(-1).at(0);
+        const size_t num_ids = Blockstate::IdMetadataToId(blockstates.rbegin()->first + 1, 0);
+#else
+        const std::shared_ptr<Blockstate> default_blockstate = blockstates.at(-1);
+        const size_t num_ids = blockstates.rbegin()->first + 1;
+#endif
+
+        flat_blockstates = std::vector<std::shared_ptr<Blockstate> >(num_ids, default_blockstate);
+
+        for (auto it = blockstates.begin(); it != blockstates.end(); ++it)
+        {
+            if (it->first < 0)
+            {
+                continue;
+            }
+#if PROTOCOL_VERSION < 347
+            // Unknown metadata fall back to metadata 0
+            auto it_default = it->second.find(0);
+            const std::shared_ptr<Blockstate> default_metadata = it_default != it->second.end() ? it_default->second : default_blockstate;
+            for (int metadata = 0; metadata < 16; ++metadata)
+            {
+                auto it2 = it->second.find(metadata);
+                flat_blockstates[Blockstate::IdMetadataToId(it->first, metadata)] = it2 != it->second.end() ? it2->second : default_metadata;
+            }
+#else
+            flat_blockstates[it->first] = it->second;
+#endif
+        }
+
+        flat_blockstates_properties.clear();
+        flat_blockstates_properties.reserve(flat_blockstates.size() + 1);
+        for (int i = 0; i < flat_blockstates.size(); ++i)
+        {
+            flat_blockstates_properties.push_back(flat_blockstates[i]->GetProperties());
+        }
+        flat_blockstates_properties.push_back(default_blockstate->GetProperties());
+    }
+
     void AssetsManager::LoadBiomesFile()
     {
         std::string file_path = ASSETS_PATH + std::string("/custom/Biomes.json");
@@ -46,6 +46,8 @@ namespace Botcraft
         }
 #endif
         auto_respawn = false;
+        use_shared_network_runtime = false;
+        batch_network_writes = false;
 
         should_be_closed = false;
 
@@ -60,13 +62,15 @@ namespace Botcraft
 
     void BaseClient::Connect(const std::string& address, const std::string& login, const std::string& password)
     {
-        network_manager = std::shared_ptr<NetworkManager>(new NetworkManager(address, login, password, ""));
+        network_manager = std::shared_ptr<NetworkManager>(new NetworkManager(address, login, password, "", use_shared_network_runtime));
+        network_manager->SetBatchWrites(batch_network_writes);
         network_manager->AddHandler(this);
     }
 
     void BaseClient::Connect(const std::string& address, const std::string& launcher_accounts_path)
     {
-        network_manager = std::shared_ptr<NetworkManager>(new NetworkManager(address, "", "", launcher_accounts_path));
+        network_manager = std::shared_ptr<NetworkManager>(new NetworkManager(address, "", "", launcher_accounts_path, use_shared_network_runtime));
+        network_manager->SetBatchWrites(batch_network_writes);
         network_manager->AddHandler(this);
     }
 
@@ -78,6 +82,9 @@ namespace Botcraft
         auto last_send = std::chrono::system_clock::now();
         std::shared_ptr<ServerboundMovePlayerPacketPosRot> msg_position(new ServerboundMovePlayerPacketPosRot);
         bool has_moved = false;
+        // Last chunk given to the world as its view center
+        bool view_center_set = false;
+        Position view_center;
 
         while (network_manager && network_manager->GetConnectionState() == ProtocolCraft::ConnectionState::Play)
         {
@@ -97,20 +104,31 @@ namespace Botcraft
                     {
                         bool is_loaded = false;
                         bool is_in_fluid = false;
+                        Position player_chunk;
                         std::lock_guard<std::mutex> player_guard(local_player->GetMutex());
                         {
-                            std::lock_guard<std::mutex> mutex_guard(world->GetMutex());
+                            std::shared_lock<std::shared_mutex> mutex_guard(world->GetMutex());
                             const Position player_position = Position(std::floor(local_player->GetX()), std::floor(local_player->GetY()), std::floor(local_player->GetZ()));
                             
                             is_loaded = world->IsLoaded(player_position);
+                            player_chunk = ToChunkCoords(player_position);
 
                             if (is_loaded)
                             {
                                 const Block* block_ptr = world->GetBlock(player_position);
-                                is_in_fluid = block_ptr && block_ptr->GetBlockstate()->IsFluid();
+                                is_in_fluid = block_ptr && block_ptr->GetProperties().fluid;
                             }
                         }
 
+                        // Chunks around the player are kept even
+                        // when the world is over its memory budget
+                        if (!view_center_set || player_chunk.x != view_center.x || player_chunk.z != view_center.z)
+                        {
+                            world->SetViewCenter(this, player_chunk.x, player_chunk.z);
+                            view_center = player_chunk;
+                            view_center_set = true;
+                        }
+
                         if (is_loaded)
                         {
                             //Check that we did not go through a block
@@ -175,6 +193,11 @@ namespace Botcraft
                     }
                 }
             }
+            // Send everything queued during this tick
+            if (network_manager)
+            {
+                network_manager->Flush();
+            }
             std::this_thread::sleep_until(end);
         }
     }
@@ -225,7 +248,7 @@ namespace Botcraft
 
                     Block block;
                     {
-                        std::lock_guard<std::mutex> mutex_guard(world->GetMutex());
+                        std::shared_lock<std::shared_mutex> mutex_guard(world->GetMutex());
                         const Block *block_ptr = world->GetBlock(cube_pos);
 
                         if (block_ptr == nullptr)
@@ -235,14 +258,14 @@ namespace Botcraft
                         block = *block_ptr;
                     }
 
-                    if (!is_in_fluid && !block.GetBlockstate()->IsSolid())
+                    if (!is_in_fluid && !block.GetProperties().solid)
                     {
                         continue;
                     }
                     
                     if (is_in_fluid &&
-                        !block.GetBlockstate()->IsSolid() &&
-                        (!block.GetBlockstate()->IsFluid() ||
+                        !block.GetProperties().solid &&
+                        (!block.GetProperties().fluid ||
                             cube_pos.y >= player_position.y))
                     {
                         continue;
@@ -338,6 +361,10 @@ namespace Botcraft
             m_thread_physics.join();
         }
 
+        if (world)
+        {
+            world->RemoveViewCenter(this);
+        }
         if (world && !world->IsShared())
         {
             world.reset();
@@ -346,6 +373,16 @@ namespace Botcraft
         entity_manager.reset();
     }
 
+    void BaseClient::SetUseSharedNetworkRuntime(const bool b)
+    {
+        use_shared_network_runtime = b;
+    }
+
+    void BaseClient::SetBatchNetworkWrites(const bool b)
+    {
+        batch_network_writes = b;
+    }
+
     void BaseClient::SetSharedWorld(const std::shared_ptr<World> world_)
     {
         world = world_;
@@ -95,7 +95,7 @@ namespace Botcraft
         Position block_normal;
         std::shared_ptr<LocalPlayer> local_player = entity_manager->GetLocalPlayer();
         {
-            std::lock_guard<std::mutex> world_guard(world->GetMutex());
+            std::shared_lock<std::shared_mutex> world_guard(world->GetMutex());
             blockstate = world->Raycast(local_player->GetPosition() + Vector3<double>(0.0, 1.65, 0.0), local_player->GetFrontVector(), 6.5f, block_position, block_normal);
         
             if (!blockstate ||
@@ -190,7 +190,7 @@ namespace Botcraft
                 Position current_position;
                 Position current_normal;
                 {
-                    std::lock_guard<std::mutex> world_guard(world->GetMutex());
+                    std::shared_lock<std::shared_mutex> world_guard(world->GetMutex());
                     current_blockstate = world->Raycast(local_player->GetPosition() + Vector3<double>(0.0, 1.65, 0.0), local_player->GetFrontVector(), 6.5f, current_position, current_normal);
                 }
 
@@ -239,10 +239,10 @@ namespace Botcraft
 
         std::shared_ptr<Blockstate> blockstate;
         {
-            std::lock_guard<std::mutex> world_guard(world->GetMutex());
+            std::shared_lock<std::shared_mutex> world_guard(world->GetMutex());
             const Block* block = world->GetBlock(location);
 
-            if (!block || block->GetBlockstate()->IsAir())
+            if (!block || block->GetProperties().air)
             {
                 return true;
             }
@@ -290,10 +290,10 @@ namespace Botcraft
                 finished_sent = true;
             }
             {
-                std::lock_guard<std::mutex> world_guard(world->GetMutex());
+                std::shared_lock<std::shared_mutex> world_guard(world->GetMutex());
                 const Block* block = world->GetBlock(location);
 
-                if (!block || block->GetBlockstate()->IsAir())
+                if (!block || block->GetProperties().air)
                 {
                     return true;
                 }
@@ -349,7 +349,7 @@ namespace Botcraft
 
             bool is_goal_loaded;
             {
-                std::lock_guard<std::mutex> world_guard(world->GetMutex());
+                std::shared_lock<std::shared_mutex> world_guard(world->GetMutex());
                 is_goal_loaded = world->IsLoaded(goal);
             }
 
@@ -544,10 +544,10 @@ namespace Botcraft
         }
 
         {
-            std::lock_guard<std::mutex> world_guard(world->GetMutex());
+            std::shared_lock<std::shared_mutex> world_guard(world->GetMutex());
             const Block* block = world->GetBlock(location);
 
-            if (block && !block->GetBlockstate()->IsAir())
+            if (block && !block->GetProperties().air)
             {
                 return false;
             }
@@ -642,7 +642,7 @@ namespace Botcraft
             }
             if (!is_block_ok)
             {
-                std::lock_guard<std::mutex> world_guard(world->GetMutex());
+                std::shared_lock<std::shared_mutex> world_guard(world->GetMutex());
                 const Block* block = world->GetBlock(location);
 
                 if (block && block->GetBlockstate()->GetName() == item)
@@ -813,48 +813,48 @@ namespace Botcraft
                 //    6  12
                 bool is_in_fluid;
                 {
-                    std::lock_guard<std::mutex> world_guard(world->GetMutex());
+                    std::shared_lock<std::shared_mutex> world_guard(world->GetMutex());
 
                     const Block* block = world->GetBlock(current_node.pos);
-                    is_in_fluid = block && block->GetBlockstate()->IsFluid();
+                    is_in_fluid = block && block->GetProperties().fluid;
 
                     // Start with 2 because if 2 is solid, no pathfinding is possible
                     block = world->GetBlock(next_location + Position(0, 1, 0));
-                    surroundings[2] = block && (block->GetBlockstate()->IsSolid() || (is_in_fluid && block->GetBlockstate()->IsFluid()));
+                    surroundings[2] = block && (block->GetProperties().solid || (is_in_fluid && block->GetProperties().fluid));
                     if (surroundings[2])
                     {
                         continue;
                     }
 
                     block = world->GetBlock(current_node.pos + Position(0, 2, 0));
-                    surroundings[0] = block && (block->GetBlockstate()->IsSolid() || (is_in_fluid && block->GetBlockstate()->IsFluid()));
+                    surroundings[0] = block && (block->GetProperties().solid || (is_in_fluid && block->GetProperties().fluid));
 
                     block = world->GetBlock(next_location + Position(0, 2, 0));
-                    surroundings[1] = block && (block->GetBlockstate()->IsSolid() || (is_in_fluid && block->GetBlockstate()->IsFluid()));
+                    surroundings[1] = block && (block->GetProperties().solid || (is_in_fluid && block->GetProperties().fluid));
                     block = world->GetBlock(next_location);
-                    surroundings[3] = block && (block->GetBlockstate()->IsSolid() || (is_in_fluid && block->GetBlockstate()->IsFluid()));
+                    surroundings[3] = block && (block->GetProperties().solid || (is_in_fluid && block->GetProperties().fluid));
                     block = world->GetBlock(next_location + Position(0, -1, 0));
-                    surroundings[4] = block && (block->GetBlockstate()->IsSolid() || (is_in_fluid && block->GetBlockstate()->IsFluid()));
+                    surroundings[4] = block && (block->GetProperties().solid || (is_in_fluid && block->GetProperties().fluid));
                     block = world->GetBlock(next_location + Position(0, -2, 0));
-                    surroundings[5] = block && (block->GetBlockstate()->IsSolid() || (is_in_fluid && block->GetBlockstate()->IsFluid()));
+                    surroundings[5] = block && (block->GetProperties().solid || (is_in_fluid && block->GetProperties().fluid));
                     block = world->GetBlock(next_location + Position(0, -3, 0));
-                    surroundings[6] = block && (block->GetBlockstate()->IsSolid() || (is_in_fluid && block->GetBlockstate()->IsFluid()));
+                    surroundings[6] = block && (block->GetProperties().solid || (is_in_fluid && block->GetProperties().fluid));
 
                     // You can't make large jumps if your feet are in fluid
                     if (can_jump && !is_in_fluid)
                     {
                         block = world->GetBlock(next_next_location + Position(0, 2, 0));
-                        surroundings[7] = block && block->GetBlockstate()->IsSolid();
+                        surroundings[7] = block && block->GetProperties().solid;
                         block = world->GetBlock(next_next_location + Position(0, 1, 0));
-                        surroundings[8] = block && block->GetBlockstate()->IsSolid();
+                        surroundings[8] = block && block->GetProperties().solid;
                         block = world->GetBlock(next_next_location);
-                        surroundings[9] = block && block->GetBlockstate()->IsSolid();
+                        surroundings[9] = block && block->GetProperties().solid;
                         block = world->GetBlock(next_next_location + Position(0, -1, 0));
-                        surroundings[10] = block && block->GetBlockstate()->IsSolid();
+                        surroundings[10] = block && block->GetProperties().solid;
                         block = world->GetBlock(next_next_location + Position(0, -2, 0));
-                        surroundings[11] = block && block->GetBlockstate()->IsSolid();
+                        surroundings[11] = block && block->GetProperties().solid;
                         block = world->GetBlock(next_next_location + Position(0, -3, 0));
-                        surroundings[12] = block && block->GetBlockstate()->IsSolid();
+                        surroundings[12] = block && block->GetProperties().solid;
                     }
                 }
 
@@ -959,20 +959,20 @@ namespace Botcraft
                     && !surroundings[4] && !surroundings[5]
                     && !surroundings[6])
                 {
-                    std::lock_guard<std::mutex> world_guard(world->GetMutex());
+                    std::shared_lock<std::shared_mutex> world_guard(world->GetMutex());
 
                     const Block* block;
 
-                    for (int y = -4; next_location.y + y >= WORLD_START_Y; --y)
+                    for (int y = -4; next_location.y + y >= world->GetMinY(); --y)
                     {
                         block = world->GetBlock(next_location + Position(0, y, 0));
 
-                        if (block && block->GetBlockstate()->IsSolid())
+                        if (block && block->GetProperties().solid)
                         {
                             break;
                         }
 
-                        if (block && block->GetBlockstate()->IsFluid() 
+                        if (block && block->GetProperties().fluid 
                             && block->GetBlockstate()->GetName() == "minecraft:water")
                         {
                             const float new_cost = cost[current_node.pos] + std::abs(y);
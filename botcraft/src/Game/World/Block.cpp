@@ -4,31 +4,15 @@
 namespace Botcraft
 {
 #if PROTOCOL_VERSION < 347
-    Block::Block(const int id_, const unsigned char metadata_)
+    Block::Block(const int id_, const unsigned char metadata_, const int model_id_)
     {
-        ChangeBlockstate(id_, metadata_);
+        ChangeBlockstate(id_, metadata_, model_id_);
     }
 
     void Block::ChangeBlockstate(const int id_, const unsigned char metadata_, const int model_id_)
     {
-        auto &blockstates_map = AssetsManager::getInstance().Blockstates();
-        auto it = blockstates_map.find(id_);
-        if (it != blockstates_map.end())
-        {
-            auto it2 = it->second.find(metadata_);
-            if (it2 != it->second.end())
-            {
-                blockstate = it2->second;
-            }
-            else
-            {
-                blockstate = it->second.at(0);
-            }
-        }
-        else
-        {
-            blockstate = blockstates_map.at(-1).at(0);
-        }
+        blockstate = AssetsManager::getInstance().GetBlockstate(id_, metadata_);
+        properties = &AssetsManager::getInstance().GetBlockstateProperties(id_, metadata_);
         if (model_id_ < 0)
         {
             model_id = blockstate->GetRandomModelId();
@@ -39,24 +23,15 @@ namespace Botcraft
         }
     }
 #else
-    Block::Block(const int id_)
+    Block::Block(const int id_, const int model_id_)
     {
-        ChangeBlockstate(id_);
+        ChangeBlockstate(id_, model_id_);
     }
 
     void Block::ChangeBlockstate(const int id_, const int model_id_)
     {
-        auto &blockstates_map = AssetsManager::getInstance().Blockstates();
-        auto it = blockstates_map.find(id_);
-        if (it != blockstates_map.end())
-        {
-            blockstate = it->second;
-        }
-        else
-        {
-            blockstate = blockstates_map.at(-1);
-        }
-
+        blockstate = AssetsManager::getInstance().GetBlockstate(id_);
+        properties = &AssetsManager::getInstance().GetBlockstateProperties(id_);
         if (model_id_ < 0)
         {
             model_id = blockstate->GetRandomModelId();
@@ -77,4 +52,19 @@ namespace Botcraft
     {
         return model_id;
     }
+
+    const BlockstateProperties& Block::GetProperties() const
+    {
+        return *properties;
+    }
+
+    const bool Block::operator==(const Block& other) const
+    {
+        return blockstate == other.blockstate && model_id == other.model_id;
+    }
+
+    const bool Block::operator!=(const Block& other) const
+    {
+        return !(*this == other);
+    }
 } //Botcraft
\ No newline at end of file
@@ -0,0 +1,106 @@
+#include "botcraft/Game/World/BlockEntityStore.hpp"
+
+#include <algorithm>
+
+using namespace ProtocolCraft;
+
+namespace Botcraft
+{
+    // Shared by all the stores without entries, never modified
+    static const std::vector<BlockEntityStore::value_type> empty_entries;
+
+    BlockEntityStore::BlockEntityStore()
+    {
+        // Most chunks don't have any block entity,
+        // entries is only allocated on first insertion
+        entries = nullptr;
+    }
+
+    std::shared_ptr<const NBT> BlockEntityStore::Get(const int index) const
+    {
+        auto it = LowerBound(index);
+        if (it == end() || it->first != index)
+        {
+            return nullptr;
+        }
+
+        return it->second;
+    }
+
+    void BlockEntityStore::Set(const int index, const std::shared_ptr<const NBT>& data)
+    {
+        Detach();
+
+        auto it = std::lower_bound(entries->begin(), entries->end(), index,
+            [](const value_type& entry, const int i) { return entry.first < i; });
+        if (it != entries->end() && it->first == index)
+        {
+            it->second = data;
+        }
+        else
+        {
+            entries->insert(it, value_type(index, data));
+        }
+    }
+
+    bool BlockEntityStore::Erase(const int index)
+    {
+        auto found = LowerBound(index);
+        if (found == end() || found->first != index)
+        {
+            return false;
+        }
+
+        const std::ptrdiff_t offset = found - begin();
+        Detach();
+        entries->erase(entries->begin() + offset);
+        return true;
+    }
+
+    void BlockEntityStore::Clear()
+    {
+        // Don't clear the vector, it may be shared with other stores
+        entries = nullptr;
+    }
+
+    const size_t BlockEntityStore::size() const
+    {
+        return entries == nullptr ? 0 : entries->size();
+    }
+
+    const bool BlockEntityStore::empty() const
+    {
+        return size() == 0;
+    }
+
+    std::vector<BlockEntityStore::value_type>::const_iterator BlockEntityStore::begin() const
+    {
+        return entries == nullptr ? empty_entries.begin() : entries->cbegin();
+    }
+
+    std::vector<BlockEntityStore::value_type>::const_iterator BlockEntityStore::end() const
+    {
+        return entries == nullptr ? empty_entries.end() : entries->cend();
+    }
+
+    std::vector<BlockEntityStore::value_type>::const_iterator BlockEntityStore::LowerBound(const int index) const
+    {
+        return std::lower_bound(begin(), end(), index,
+            [](const value_type& entry, const int i) { return entry.first < i; });
+    }
+
+    void BlockEntityStore::Detach()
+    {
+        if (entries == nullptr)
+        {
+            entries = std::make_shared<std::vector<value_type> >();
+        }
+        // Stores are only modified with the world locked, so
+        // use_count can't go from 1 to more while we modify it
+        else if (entries.use_count() > 1)
+        {
+            // Only copy the pointers, the NBT are immutable
+            entries = std::make_shared<std::vector<value_type> >(*entries);
+        }
+    }
+} // Botcraft
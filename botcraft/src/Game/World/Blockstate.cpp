@@ -632,6 +632,11 @@ namespace Botcraft
         return tint_type;
     }
 
+    const BlockstateProperties Blockstate::GetProperties() const
+    {
+        return BlockstateProperties{ hardness, IsAir(), solid, transparent, fluid };
+    }
+
 #if PROTOCOL_VERSION < 347
     const unsigned int Blockstate::IdMetadataToId(const unsigned int id_, const unsigned char metadata_)
     {
@@ -1,9 +1,16 @@
 #include "botcraft/Game/World/Chunk.hpp"
 #include "botcraft/Game/World/Section.hpp"
+#include "botcraft/Game/AssetsManager.hpp"
+
+#include "botcraft/Utilities/BitUnpacking.hpp"
 
 #include "protocolCraft/Types/NBT/TagInt.hpp"
 
 #include <iostream>
+#include <stdexcept>
+#include <unordered_map>
+#include <algorithm>
+#include <atomic>
 
 using namespace ProtocolCraft;
 
@@ -22,59 +29,104 @@ namespace Botcraft
         GlobalPalette
     };
 
-#if PROTOCOL_VERSION < 719
-    Chunk::Chunk(const Dimension &dim)
+    // Biome palette indices are stored on one byte
+    static const int MAX_BIOME_PALETTE_INDEX = 255;
+
+    static const Biome* ResolveBiome(const int id)
+    {
+        // Biomes are owned by the AssetsManager and never
+        // destroyed, so the raw pointer can be kept
+#if PROTOCOL_VERSION < 358
+        return AssetsManager::getInstance().GetBiome(static_cast<unsigned char>(id)).get();
 #else
-    Chunk::Chunk(const std::string& dim)
+        return AssetsManager::getInstance().GetBiome(id).get();
 #endif
+    }
+
+    // If block must be taken into account in the heightmap type.
+    // All heightmaps are computed locally with this definition,
+    // the ones sent by the server are ignored
+    static const bool IsInHeightmap(const Block* block, const Heightmap type)
     {
-        dimension = dim;
-#if PROTOCOL_VERSION < 358
-        biomes = std::vector<unsigned char>(CHUNK_WIDTH * CHUNK_WIDTH, 0);
-#elif PROTOCOL_VERSION < 552
-        biomes = std::vector<int>(CHUNK_WIDTH * CHUNK_WIDTH, 0);
+        if (block == nullptr || block->GetProperties().air)
+        {
+            return false;
+        }
+
+        switch (type)
+        {
+        case Heightmap::MotionBlocking:
+            return block->GetProperties().solid || block->GetProperties().fluid;
+        case Heightmap::Solid:
+            return block->GetProperties().solid;
+        case Heightmap::NonFluid:
+            return !block->GetProperties().fluid;
+        default:
+            return false;
+        }
+    }
+
+#if PROTOCOL_VERSION < 719
+    Chunk::Chunk(const int min_y_, const int height_, const Dimension &dim)
 #else
-		biomes = std::vector<int>(BIOMES_SIZE, 0);
+    Chunk::Chunk(const int min_y_, const int height_, const std::string& dim)
 #endif
-        sections = std::vector<std::shared_ptr<Section> >(CHUNK_HEIGHT / SECTION_HEIGHT);
+    {
+        dimension = dim;
+        min_y = min_y_;
+        height = height_;
+        ResetBiomes();
+        // Sections are only allocated when something is added in them
+
+        for (int i = 0; i < NUM_HEIGHTMAPS; ++i)
+        {
+            heightmaps[i].fill(0);
+        }
 
 #if USE_GUI
         modified_since_last_rendered = true;
 #endif
+        data_hash = 0;
+        memory_usage = 0;
     }
 
     Chunk::Chunk(const Chunk& c)
     {
         dimension = c.dimension;
-#if PROTOCOL_VERSION < 358
-        biomes = c.biomes;
-#elif PROTOCOL_VERSION < 552
-        biomes = c.biomes;
-#else
-        biomes = c.biomes;
+        min_y = c.min_y;
+        height = c.height;
+        num_biome_cells = c.num_biome_cells;
+        biome_palette = c.biome_palette;
+        biome_indices = c.biome_indices;
+        // Sections are shared, they are cloned
+        // only when one of the chunks modifies them
+        sections = c.sections;
+
+        // NBT are immutable, no need to clone them
+        block_entities_data = c.block_entities_data;
+
+        heightmaps = c.heightmaps;
+
+#if USE_GUI
+        modified_since_last_rendered = c.modified_since_last_rendered;
 #endif
-        sections = std::vector<std::shared_ptr<Section> >(CHUNK_HEIGHT / SECTION_HEIGHT);
-        for (int i = 0; i < c.sections.size(); i++)
-        {
-            if (c.sections[i] == nullptr)
-            {
-                sections[i] = nullptr;
-            }
-            else
-            {
-                sections[i] = std::shared_ptr<Section>(new Section(*c.sections[i]));
-            }
-        }
+        data_hash = c.data_hash;
+        memory_usage = c.memory_usage;
+    }
 
-        for (auto it = c.block_entities_data.begin(); it != c.block_entities_data.end(); it++)
-        {
-            block_entities_data[it->first] = std::shared_ptr<NBT>(new NBT(*it->second));
-        }
+    const int Chunk::GetMinY() const
+    {
+        return min_y;
+    }
+
+    const int Chunk::GetHeight() const
+    {
+        return height;
     }
 
     const Position Chunk::BlockCoordsToChunkCoords(const Position& pos)
     {
-        return Position((int)floor(pos.x / (double)CHUNK_WIDTH), 0, (int)floor(pos.z / (double)CHUNK_WIDTH));
+        return ToChunkCoords(pos);
     }
 
 #if USE_GUI
@@ -90,14 +142,14 @@ namespace Botcraft
 #endif
 
 #if PROTOCOL_VERSION < 552
-    void Chunk::LoadChunkData(const std::vector<unsigned char>& data, const int primary_bit_mask, const bool ground_up_continuous)
+    void Chunk::LoadChunkData(const ProtocolCraft::ByteSlice& data, const int primary_bit_mask, const bool ground_up_continuous)
 #elif PROTOCOL_VERSION < 755
-    void Chunk::LoadChunkData(const std::vector<unsigned char>& data, const int primary_bit_mask)
+    void Chunk::LoadChunkData(const ProtocolCraft::ByteSlice& data, const int primary_bit_mask)
 #else
-    void Chunk::LoadChunkData(const std::vector<unsigned char>& data, const std::vector<unsigned long long int>& primary_bit_mask)
+    void Chunk::LoadChunkData(const ProtocolCraft::ByteSlice& data, const std::vector<unsigned long long int>& primary_bit_mask)
 #endif
     {
-        std::vector<unsigned char>::const_iterator iter = data.begin();
+        ProtocolCraft::ReadIterator iter = data.begin();
         size_t length = data.size();
 
         if (data.size() == 0)
@@ -106,13 +158,16 @@ namespace Botcraft
             return;
         }
 
+        std::vector<unsigned long long int> data_array;
+        std::vector<unsigned short> indices(CHUNK_WIDTH * CHUNK_WIDTH * SECTION_HEIGHT);
+
         //The chunck sections
-        for (int sectionY = 0; sectionY < CHUNK_HEIGHT / SECTION_HEIGHT; ++sectionY)
+        for (int sectionY = 0; sectionY < height / SECTION_HEIGHT; ++sectionY)
         {
 #if PROTOCOL_VERSION < 755
             if (!(primary_bit_mask & (1 << sectionY)))
 #else
-            if (!(primary_bit_mask[sectionY / 64] & (1 << (sectionY % 64))))
+            if (primary_bit_mask.size() <= sectionY / 64 || !((primary_bit_mask[sectionY / 64] >> (sectionY % 64)) & 1))
 #endif
             {
                 continue;
@@ -157,110 +212,108 @@ namespace Botcraft
                 }
             }
 
-            //A mask 0...01..1 with bits_per_block ones
-            unsigned int individual_value_mask = (unsigned int)((1 << bits_per_block) - 1);
-
             //Data array length
             int data_array_size = ReadData<VarInt>(iter, length);
 
             //Data array
-            std::vector<unsigned long long int> data_array(data_array_size);
-            for (int i = 0; i < data_array_size; ++i)
+            if (data_array_size < 0 || length < data_array_size * sizeof(unsigned long long int))
             {
-                data_array[i] = ReadData<unsigned long long int>(iter, length);
+                std::cerr << "Error, not enough data to read the blocks data array. Stop loading chunk data" << std::endl;
+                return;
             }
+            data_array.resize(data_array_size);
+            BigEndianLongsToHost(&(*iter), data_array_size, data_array.data());
+            iter += data_array_size * sizeof(unsigned long long int);
+            length -= data_array_size * sizeof(unsigned long long int);
 
             //Blocks data
-#if PROTOCOL_VERSION > 712
-            int bit_offset = 0;
-#endif
-            for (int block_y = 0; block_y < SECTION_HEIGHT; ++block_y)
+            // From protocol version 713, the compacted array format has been adjusted so that
+            //individual entries no longer span across multiple longs
+            if (!UnpackBits(data_array.data(), data_array.size(), bits_per_block, PROTOCOL_VERSION < 713, indices.size(), indices.data()))
+            {
+                std::cerr << "Error, blocks data array is too small. Stop loading chunk data" << std::endl;
+                return;
+            }
+
+            if (palette_type == Palette::GlobalPalette)
             {
-                for (int block_z = 0; block_z < CHUNK_WIDTH; ++block_z)
+                // Build a palette with the ids used in this section
+                std::unordered_map<unsigned short, unsigned short> global_to_local;
+                for (int i = 0; i < indices.size(); ++i)
                 {
-                    for (int block_x = 0; block_x < CHUNK_WIDTH; ++block_x)
+                    auto it = global_to_local.find(indices[i]);
+                    if (it == global_to_local.end())
                     {
+                        it = global_to_local.insert({ indices[i], static_cast<unsigned short>(palette.size()) }).first;
+                        palette.push_back(indices[i]);
+                    }
+                    indices[i] = it->second;
+                }
+            }
+            else
+            {
+                for (int i = 0; i < indices.size(); ++i)
+                {
+                    if (indices[i] >= palette.size())
+                    {
+                        std::cerr << "Error, block palette index out of range. Stop loading chunk data" << std::endl;
+                        return;
+                    }
+                }
+            }
 
-#if PROTOCOL_VERSION > 712
-                        // From protocol version 713, the compacted array format has been adjusted so that
-                        //individual entries no longer span across multiple longs
-                        if (64 - (bit_offset % 64) < bits_per_block)
-                        {
-                            bit_offset += 64 - (bit_offset % 64);
-                        }
-                        int start_long_index = bit_offset / 64;
-                        int end_long_index = start_long_index;
-                        int start_offset = bit_offset % 64;
-                        bit_offset += bits_per_block;
-#else
-                        int block_index = (((block_y * SECTION_HEIGHT) + block_z) * CHUNK_WIDTH) + block_x;
-                        int start_long_index = (block_index * bits_per_block) / 64;
-                        int start_offset = (block_index * bits_per_block) % 64;
-                        int end_long_index = ((block_index + 1) * bits_per_block - 1) / 64;
-#endif
-                        unsigned int raw_id;
-                        if (start_long_index == end_long_index)
-                        {
-                            raw_id = (unsigned int)(data_array[start_long_index] >> start_offset);
-                        }
-                        else
-                        {
-                            int end_offset = 64 - start_offset;
-                            raw_id = (unsigned int)(data_array[start_long_index] >> start_offset | data_array[end_long_index] << end_offset);
-                        }
-                        raw_id &= individual_value_mask;
-
-                        if (palette_type != Palette::GlobalPalette)
-                        {
-                            raw_id = palette[raw_id];
-                        }
-
+            // Blockstates with multiple models get a random model
+            // once per palette entry, not for each block, so the
+            // section is loaded without any per-block SetBlock
+            std::vector<Block> blocks_palette;
+            blocks_palette.reserve(palette.size());
+            bool all_air = true;
+            for (int i = 0; i < palette.size(); ++i)
+            {
 #if PROTOCOL_VERSION < 347
-                        unsigned int id;
-                        unsigned char metadata;
-
-                        Blockstate::IdToIdMetadata(raw_id, id, metadata);
+                unsigned int id;
+                unsigned char metadata;
 
-                        SetBlock(Position(block_x, block_y + sectionY * SECTION_HEIGHT, block_z), id, metadata);
+                Blockstate::IdToIdMetadata(palette[i], id, metadata);
+                blocks_palette.push_back(Block(id, metadata));
 #else
-                        SetBlock(Position(block_x, block_y + sectionY * SECTION_HEIGHT, block_z), raw_id);
+                blocks_palette.push_back(Block(palette[i]));
 #endif
-                    }
-                }
+                all_air &= blocks_palette.back().GetProperties().air;
+            }
+
+            if (!HasSection(sectionY) && !all_air)
+            {
+                AddSection(sectionY);
+            }
+
+            if (HasSection(sectionY))
+            {
+                GetWritableSection(sectionY).LoadBlocks(blocks_palette, indices.data());
             }
 
 #if PROTOCOL_VERSION <= 404
             //Block light
-            for (int block_y = 0; block_y < SECTION_HEIGHT; ++block_y)
+            if (length < LIGHT_DATA_SIZE)
             {
-                for (int block_z = 0; block_z < CHUNK_WIDTH; ++block_z)
-                {
-                    for (int block_x = 0; block_x < CHUNK_WIDTH; block_x += 2)
-                    {
-                        unsigned char two_light_values = ReadData<unsigned char>(iter, length);
-
-                        SetBlockLight(Position(block_x, block_y + sectionY * SECTION_HEIGHT, block_z), two_light_values & 0x0F);
-                        SetBlockLight(Position(block_x + 1, block_y + sectionY * SECTION_HEIGHT, block_z), (two_light_values >> 4) & 0x0F);
-                    }
-                }
+                std::cerr << "Error, not enough data to read the block light. Stop loading chunk data" << std::endl;
+                return;
             }
+            LoadSectionLight(sectionY, &(*iter), false);
+            iter += LIGHT_DATA_SIZE;
+            length -= LIGHT_DATA_SIZE;
 
             //Sky light
             if (GetDimension() == Dimension::Overworld)
             {
-                for (int block_y = 0; block_y < SECTION_HEIGHT; ++block_y)
+                if (length < LIGHT_DATA_SIZE)
                 {
-                    for (int block_z = 0; block_z < CHUNK_WIDTH; ++block_z)
-                    {
-                        for (int block_x = 0; block_x < CHUNK_WIDTH; block_x += 2)
-                        {
-                            unsigned char two_light_values = ReadData<unsigned char>(iter, length);
-
-                            SetSkyLight(Position(block_x, block_y + sectionY * SECTION_HEIGHT, block_z), two_light_values & 0x0F);
-                            SetSkyLight(Position(block_x + 1, block_y + sectionY * SECTION_HEIGHT, block_z), (two_light_values >> 4) & 0x0F);
-                        }
-                    }
+                    std::cerr << "Error, not enough data to read the sky light. Stop loading chunk data" << std::endl;
+                    return;
                 }
+                LoadSectionLight(sectionY, &(*iter), true);
+                iter += LIGHT_DATA_SIZE;
+                length -= LIGHT_DATA_SIZE;
             }
 #endif
         }
@@ -269,19 +322,20 @@ namespace Botcraft
         //The biomes
         if (ground_up_continuous)
         {
-            for (int block_z = 0; block_z < CHUNK_WIDTH; ++block_z)
+            std::vector<int> new_biomes(num_biome_cells);
+            for (int i = 0; i < num_biome_cells; ++i)
             {
-                for (int block_x = 0; block_x < CHUNK_WIDTH; ++block_x)
-                {
 #if PROTOCOL_VERSION < 358 
-                    SetBiome(block_x, block_z, ReadData<unsigned char>(iter, length));
+                new_biomes[i] = ReadData<unsigned char>(iter, length);
 #else
-                    SetBiome(block_x, block_z, ReadData<int>(iter, length));
+                new_biomes[i] = ReadData<int>(iter, length);
 #endif
-                }
             }
+            LoadBiomes(new_biomes);
         }
 #endif
+        ComputeHeightmaps();
+
 #if USE_GUI
         modified_since_last_rendered = true;
 #endif
@@ -290,7 +344,7 @@ namespace Botcraft
     void Chunk::LoadChunkBlockEntitiesData(const std::vector<NBT>& block_entities)
     {
         // Block entities data
-        block_entities_data.clear();
+        block_entities_data.Clear();
 
         for (int i = 0; i < block_entities.size(); ++i)
         {
@@ -300,9 +354,10 @@ namespace Botcraft
                 std::shared_ptr<TagInt> tag_y = std::dynamic_pointer_cast<TagInt>(block_entities[i].GetTag("y"));
                 std::shared_ptr<TagInt> tag_z = std::dynamic_pointer_cast<TagInt>(block_entities[i].GetTag("z"));
 
-                if (tag_x && tag_y && tag_z)
+                if (tag_x && tag_y && tag_z && tag_y->GetValue() >= min_y && tag_y->GetValue() < min_y + height)
                 {
-                    block_entities_data[Position(tag_x->GetValue(), tag_y->GetValue(), tag_z->GetValue())] = std::shared_ptr<NBT>(new NBT(block_entities[i]));
+                    block_entities_data.Set(BlockEntityStore::PackIndex(ToChunkLocalCoord(tag_x->GetValue()), tag_y->GetValue() - min_y, ToChunkLocalCoord(tag_z->GetValue())),
+                        std::make_shared<const NBT>(block_entities[i]));
                 }
             }
         }
@@ -314,17 +369,17 @@ namespace Botcraft
 
     const Block *Chunk::GetBlock(const Position &pos) const
     {
-        if (pos.x < -1 || pos.x > CHUNK_WIDTH || pos.y < 0 || pos.y > CHUNK_HEIGHT - 1 || pos.z < -1 || pos.z > CHUNK_WIDTH)
+        if (pos.x < 0 || pos.x > CHUNK_WIDTH - 1 || pos.y < min_y || pos.y > min_y + height - 1 || pos.z < 0 || pos.z > CHUNK_WIDTH - 1)
         {
             return nullptr;
         }
 
-        if (!sections[pos.y / SECTION_HEIGHT])
+        if (!HasSection(ToSectionCoord(pos.y - min_y)))
         {
             return nullptr;
         }
 
-        return sections[pos.y / SECTION_HEIGHT]->data_blocks.data() + ((pos.y % SECTION_HEIGHT) * (CHUNK_WIDTH + 2) * (CHUNK_WIDTH + 2) + (pos.z + 1) * (CHUNK_WIDTH + 2) + pos.x + 1);
+        return sections[ToSectionCoord(pos.y - min_y)]->GetBlock(ToSectionBlockIndex(pos.x, ToSectionLocalCoord(pos.y), pos.z));
     }
 
 #if PROTOCOL_VERSION < 347
@@ -333,12 +388,12 @@ namespace Botcraft
     void Chunk::SetBlock(const Position &pos, const unsigned int id, const int model_id)
 #endif
     {
-        if (pos.x < -1 || pos.x > CHUNK_WIDTH || pos.y < 0 || pos.y > CHUNK_HEIGHT - 1 || pos.z < -1 || pos.z > CHUNK_WIDTH)
+        if (pos.x < 0 || pos.x > CHUNK_WIDTH - 1 || pos.y < min_y || pos.y > min_y + height - 1 || pos.z < 0 || pos.z > CHUNK_WIDTH - 1)
         {
             return;
         }
 
-        if (!sections[pos.y / SECTION_HEIGHT])
+        if (!HasSection(ToSectionCoord(pos.y - min_y)))
         {
             if (id == 0)
             {
@@ -346,17 +401,16 @@ namespace Botcraft
             }
             else
             {
-                AddSection(pos.y / SECTION_HEIGHT);
+                AddSection(ToSectionCoord(pos.y - min_y));
             }
         }
-        Block *block = sections[pos.y / SECTION_HEIGHT]->data_blocks.data() + ((pos.y % SECTION_HEIGHT) * (CHUNK_WIDTH + 2) * (CHUNK_WIDTH + 2) + (pos.z + 1) * (CHUNK_WIDTH + 2) + pos.x + 1);
-
 
 #if PROTOCOL_VERSION < 347
-        block->ChangeBlockstate(id, metadata, model_id);
+        GetWritableSection(ToSectionCoord(pos.y - min_y)).SetBlock(ToSectionBlockIndex(pos.x, ToSectionLocalCoord(pos.y), pos.z), Block(id, metadata, model_id));
 #else
-        block->ChangeBlockstate(id, model_id);
+        GetWritableSection(ToSectionCoord(pos.y - min_y)).SetBlock(ToSectionBlockIndex(pos.x, ToSectionLocalCoord(pos.y), pos.z), Block(id, model_id));
 #endif
+        UpdateHeightmaps(pos.x, pos.y, pos.z);
 
 #if USE_GUI
         modified_since_last_rendered = true;
@@ -375,41 +429,254 @@ namespace Botcraft
         }
         else
         {
-#if PROTOCOL_VERSION < 347
-            SetBlock(pos, block->GetBlockstate()->GetId(), block->GetBlockstate()->GetMetadata(), block->GetModelId());
-#else
-            SetBlock(pos, block->GetBlockstate()->GetId(), block->GetModelId());
+            if (pos.x < 0 || pos.x > CHUNK_WIDTH - 1 || pos.y < min_y || pos.y > min_y + height - 1 || pos.z < 0 || pos.z > CHUNK_WIDTH - 1)
+            {
+                return;
+            }
+
+            if (!HasSection(ToSectionCoord(pos.y - min_y)))
+            {
+                if (block->GetProperties().air)
+                {
+                    return;
+                }
+                else
+                {
+                    AddSection(ToSectionCoord(pos.y - min_y));
+                }
+            }
+
+            // Copy the block directly, no need to go through the blockstates map again
+            GetWritableSection(ToSectionCoord(pos.y - min_y)).SetBlock(ToSectionBlockIndex(pos.x, ToSectionLocalCoord(pos.y), pos.z), *block);
+            UpdateHeightmaps(pos.x, pos.y, pos.z);
+
+#if USE_GUI
+            modified_since_last_rendered = true;
 #endif
         }
     }
+
+    void Chunk::SetSectionBlocks(const int y, const std::vector<short>& positions, const std::vector<Block>& blocks)
+    {
+        if (positions.size() != blocks.size())
+        {
+            return;
+        }
+
+        if (!HasSection(y))
+        {
+            if (std::all_of(blocks.begin(), blocks.end(), [](const Block& b) { return b.GetProperties().air; }))
+            {
+                return;
+            }
+            AddSection(y);
+            if (!HasSection(y))
+            {
+                return;
+            }
+        }
+
+        Section& section = GetWritableSection(y);
+        for (int i = 0; i < positions.size(); ++i)
+        {
+            section.SetBlock(ToSectionBlockIndex((positions[i] >> 8) & 0x0F, positions[i] & 0x0F, (positions[i] >> 4) & 0x0F), blocks[i]);
+            UpdateHeightmaps((positions[i] >> 8) & 0x0F, min_y + y * SECTION_HEIGHT + (positions[i] & 0x0F), (positions[i] >> 4) & 0x0F);
+        }
+
+#if USE_GUI
+        modified_since_last_rendered = true;
+#endif
+    }
+
+    const int Chunk::GetHighestBlock(const Heightmap type, const int x, const int z) const
+    {
+        if (x < 0 || x > CHUNK_WIDTH - 1 || z < 0 || z > CHUNK_WIDTH - 1)
+        {
+            return min_y - 1;
+        }
+
+        return min_y - 1 + heightmaps[static_cast<int>(type)][z * CHUNK_WIDTH + x];
+    }
+
+    void Chunk::ComputeHeightmaps()
+    {
+        for (int z = 0; z < CHUNK_WIDTH; ++z)
+        {
+            for (int x = 0; x < CHUNK_WIDTH; ++x)
+            {
+                std::array<bool, NUM_HEIGHTMAPS> found;
+                found.fill(false);
+                int num_found = 0;
+                for (int i = 0; i < NUM_HEIGHTMAPS; ++i)
+                {
+                    heightmaps[i][z * CHUNK_WIDTH + x] = 0;
+                }
+
+                // Go down from the highest section until all the heightmaps are found
+                for (int s = static_cast<int>(sections.size()) - 1; s >= 0 && num_found < NUM_HEIGHTMAPS; --s)
+                {
+                    if (sections[s] == nullptr)
+                    {
+                        continue;
+                    }
+
+                    for (int y = SECTION_HEIGHT - 1; y >= 0 && num_found < NUM_HEIGHTMAPS; --y)
+                    {
+                        const Block* block = sections[s]->GetBlock(ToSectionBlockIndex(x, y, z));
+                        for (int i = 0; i < NUM_HEIGHTMAPS; ++i)
+                        {
+                            if (!found[i] && IsInHeightmap(block, static_cast<Heightmap>(i)))
+                            {
+                                found[i] = true;
+                                num_found += 1;
+                                heightmaps[i][z * CHUNK_WIDTH + x] = static_cast<unsigned short>(s * SECTION_HEIGHT + y + 1);
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    void Chunk::UpdateHeightmaps(const int x, const int y, const int z)
+    {
+        const Block* block = GetBlock(Position(x, y, z));
+        const unsigned short value = static_cast<unsigned short>(y - min_y + 1);
+
+        for (int i = 0; i < NUM_HEIGHTMAPS; ++i)
+        {
+            unsigned short& current = heightmaps[i][z * CHUNK_WIDTH + x];
+            if (IsInHeightmap(block, static_cast<Heightmap>(i)))
+            {
+                current = std::max(current, value);
+            }
+            // The highest block has been removed, look for the next one below
+            else if (current == value)
+            {
+                current = 0;
+                for (int below = y - 1; below >= min_y; --below)
+                {
+                    if (IsInHeightmap(GetBlock(Position(x, below, z)), static_cast<Heightmap>(i)))
+                    {
+                        current = static_cast<unsigned short>(below - min_y + 1);
+                        break;
+                    }
+                }
+            }
+        }
+    }
+
+    void Chunk::CopyRegion(const Position& min, const Position& max, const size_t stride_z, const size_t stride_y,
+        unsigned int* ids, unsigned char* block_light, unsigned char* sky_light) const
+    {
+        const int min_x = std::max(0, min.x);
+        const int max_x = std::min(CHUNK_WIDTH - 1, max.x);
+        const int min_z = std::max(0, min.z);
+        const int max_z = std::min(CHUNK_WIDTH - 1, max.z);
+        if (min_x > max_x || min_z > max_z)
+        {
+            return;
+        }
+
+        const int first_section = std::max(0, ToSectionCoord(min.y - min_y));
+        const int last_section = std::min(static_cast<int>(sections.size()) - 1, ToSectionCoord(max.y - min_y));
+        for (int s = first_section; s <= last_section; ++s)
+        {
+            if (sections[s] == nullptr)
+            {
+                continue;
+            }
+
+            const int section_min_y = min_y + s * SECTION_HEIGHT;
+            const int min_section_y = std::max(min.y, section_min_y);
+            const int max_section_y = std::min(max.y, section_min_y + SECTION_HEIGHT - 1);
+            const size_t offset = (min_section_y - min.y) * stride_y + (min_z - min.z) * stride_z + (min_x - min.x);
+
+            sections[s]->CopyRegion(Position(min_x, min_section_y - section_min_y, min_z), Position(max_x, max_section_y - section_min_y, max_z),
+                stride_z, stride_y, ids + offset,
+                block_light == nullptr ? nullptr : block_light + offset,
+                sky_light == nullptr ? nullptr : sky_light + offset);
+        }
+    }
+
+    void Chunk::BuildBlockIndex(const BlockPredicate* selector)
+    {
+        for (int i = 0; i < sections.size(); ++i)
+        {
+            if (sections[i] != nullptr)
+            {
+                GetWritableSection(i).BuildIndex(selector);
+            }
+        }
+    }
+
+    void Chunk::UpdateBlockIndex(const Position& pos, const BlockPredicate& selector)
+    {
+        if (pos.x < 0 || pos.x > CHUNK_WIDTH - 1 || pos.y < min_y || pos.y > min_y + height - 1 || pos.z < 0 || pos.z > CHUNK_WIDTH - 1)
+        {
+            return;
+        }
+
+        if (!HasSection(ToSectionCoord(pos.y - min_y)))
+        {
+            return;
+        }
+
+        GetWritableSection(ToSectionCoord(pos.y - min_y)).UpdateIndex(ToSectionBlockIndex(pos.x, ToSectionLocalCoord(pos.y), pos.z), selector);
+    }
+
+    void Chunk::FindBlocks(const int y, const BlockPredicate& predicate, const BlockPredicate* selector, std::vector<Position>& out) const
+    {
+        if (!HasSection(y))
+        {
+            return;
+        }
+
+        std::vector<int> indices;
+        sections[y]->FindBlocks(predicate, selector, indices);
+
+        out.reserve(out.size() + indices.size());
+        for (int i = 0; i < indices.size(); ++i)
+        {
+            out.push_back(Position(
+                indices[i] & (CHUNK_WIDTH - 1),
+                min_y + y * SECTION_HEIGHT + (indices[i] >> (2 * CHUNK_WIDTH_BITS)),
+                (indices[i] >> CHUNK_WIDTH_BITS) & (CHUNK_WIDTH - 1)));
+        }
+    }
+
     const unsigned char Chunk::GetBlockLight(const Position &pos) const
     {
-        if (pos.x < 0 || pos.x > CHUNK_WIDTH - 1 || pos.y < 0 || pos.y > CHUNK_HEIGHT - 1 || pos.z < 0 || pos.z > CHUNK_WIDTH - 1)
+        if (pos.x < 0 || pos.x > CHUNK_WIDTH - 1 || pos.y < min_y || pos.y > min_y + height - 1 || pos.z < 0 || pos.z > CHUNK_WIDTH - 1)
         {
             return 0;
         }
         
-        if (!sections[pos.y / SECTION_HEIGHT])
+        if (!HasSection(ToSectionCoord(pos.y - min_y)))
         {
             return 0;
         }
 
-        return sections[pos.y / SECTION_HEIGHT]->block_light[(pos.y % SECTION_HEIGHT) * CHUNK_WIDTH * CHUNK_WIDTH + pos.z * CHUNK_WIDTH + pos.x];
+        return sections[ToSectionCoord(pos.y - min_y)]->GetBlockLight(ToSectionBlockIndex(pos.x, ToSectionLocalCoord(pos.y), pos.z));
     }
 
     void Chunk::SetBlockLight(const Position &pos, const unsigned char v)
     {
-        if (pos.x < 0 || pos.x > CHUNK_WIDTH - 1 || pos.y < 0 || pos.y > CHUNK_HEIGHT - 1 || pos.z < 0 || pos.z > CHUNK_WIDTH - 1)
+        if (pos.x < 0 || pos.x > CHUNK_WIDTH - 1 || pos.y < min_y || pos.y > min_y + height - 1 || pos.z < 0 || pos.z > CHUNK_WIDTH - 1)
         {
             return;
         }
 
-        if (!sections[pos.y / SECTION_HEIGHT])
+        if (!HasSection(ToSectionCoord(pos.y - min_y)))
         {
-            AddSection(pos.y / SECTION_HEIGHT);
+            if (v == 0)
+            {
+                return;
+            }
+            AddSection(ToSectionCoord(pos.y - min_y));
         }
 
-        sections[pos.y / SECTION_HEIGHT]->block_light[(pos.y % SECTION_HEIGHT) * CHUNK_WIDTH * CHUNK_WIDTH + pos.z * CHUNK_WIDTH + pos.x] = v;
+        GetWritableSection(ToSectionCoord(pos.y - min_y)).SetBlockLight(ToSectionBlockIndex(pos.x, ToSectionLocalCoord(pos.y), pos.z), v);
 
         // Not necessary as we don't render lights
 //#if USE_GUI
@@ -419,304 +686,341 @@ namespace Botcraft
 
     const unsigned char Chunk::GetSkyLight(const Position &pos) const
     {
-#if PROTOCOL_VERSION < 719
-        if (dimension != Dimension::Overworld
-#else
-        if (dimension != "minecraft:overworld"
-#endif
-            || pos.x < 0 || pos.x > CHUNK_WIDTH - 1 || pos.y < 0 || pos.y > CHUNK_HEIGHT - 1 || pos.z < 0 || pos.z > CHUNK_WIDTH - 1)
+        if (pos.x < 0 || pos.x > CHUNK_WIDTH - 1 || pos.y < min_y || pos.y > min_y + height - 1 || pos.z < 0 || pos.z > CHUNK_WIDTH - 1)
         {
             return 0;
         }
 
-        if (!sections[pos.y / SECTION_HEIGHT])
+        if (!HasSection(ToSectionCoord(pos.y - min_y)))
         {
             return 0;
         }
 
-        return sections[pos.y / SECTION_HEIGHT]->sky_light[(pos.y % SECTION_HEIGHT) * CHUNK_WIDTH * CHUNK_WIDTH + pos.z * CHUNK_WIDTH + pos.x];
+        return sections[ToSectionCoord(pos.y - min_y)]->GetSkyLight(ToSectionBlockIndex(pos.x, ToSectionLocalCoord(pos.y), pos.z));
     }
 
     void Chunk::SetSkyLight(const Position &pos, const unsigned char v)
     {
-#if PROTOCOL_VERSION < 719
-        if (dimension != Dimension::Overworld
-#else
-        if (dimension != "minecraft:overworld"
-#endif
-            || pos.x < 0 || pos.x > CHUNK_WIDTH - 1 || pos.y < 0 || pos.y > CHUNK_HEIGHT - 1 || pos.z < 0 || pos.z > CHUNK_WIDTH - 1)
+        if (pos.x < 0 || pos.x > CHUNK_WIDTH - 1 || pos.y < min_y || pos.y > min_y + height - 1 || pos.z < 0 || pos.z > CHUNK_WIDTH - 1)
         {
             return;
         }
 
-        if (!sections[pos.y / SECTION_HEIGHT])
+        if (!HasSection(ToSectionCoord(pos.y - min_y)))
         {
-            AddSection(pos.y / SECTION_HEIGHT);
+            if (v == 0)
+            {
+                return;
+            }
+            AddSection(ToSectionCoord(pos.y - min_y));
         }
 
-        sections[pos.y / SECTION_HEIGHT]->block_light[(pos.y % SECTION_HEIGHT) * CHUNK_WIDTH * CHUNK_WIDTH + pos.z * CHUNK_WIDTH + pos.x] = v;
+        GetWritableSection(ToSectionCoord(pos.y - min_y)).SetSkyLight(ToSectionBlockIndex(pos.x, ToSectionLocalCoord(pos.y), pos.z), v);
         // Not necessary as we don't render lights
 //#if USE_GUI
 //        modified_since_last_rendered = true;
 //#endif
     }
 
-#if PROTOCOL_VERSION < 358
-	const unsigned char Chunk::GetBiome(const int x, const int z) const
-	{
-		if (x < 0 || x > CHUNK_WIDTH - 1 || z < 0 || z > CHUNK_WIDTH - 1)
-		{
-			return 0;
-		}
+    void Chunk::LoadSectionLight(const int y, const unsigned char* data, const bool sky)
+    {
+        if (!HasSection(y))
+        {
+            // Missing sections already have 0 light
+            if (data == nullptr || std::all_of(data, data + LIGHT_DATA_SIZE, [](const unsigned char c) { return c == 0; }))
+            {
+                return;
+            }
+            AddSection(y);
+            if (!HasSection(y))
+            {
+                return;
+            }
+        }
 
-		return biomes[z * CHUNK_WIDTH + x];
-	}
+        if (sky)
+        {
+            GetWritableSection(y).LoadSkyLight(data);
+        }
+        else
+        {
+            GetWritableSection(y).LoadBlockLight(data);
+        }
+    }
 
-	void Chunk::SetBiome(const int x, const int z, const unsigned char b)
-	{
-		if (x < 0 || x > CHUNK_WIDTH - 1 || z < 0 || z > CHUNK_WIDTH - 1)
-		{
-			return;
-		}
+    void Chunk::CopyLight(const Chunk& other)
+    {
+        if (other.min_y != min_y || other.height != height)
+        {
+            return;
+        }
 
-		biomes[z * CHUNK_WIDTH + x] = b;
+        for (int y = 0; y < height / SECTION_HEIGHT; ++y)
+        {
+            if (other.HasSection(y))
+            {
+                if (!HasSection(y))
+                {
+                    AddSection(y);
+                }
+                GetWritableSection(y).CopyLight(*other.sections[y]);
+            }
+            // Missing sections have 0 light
+            else if (HasSection(y))
+            {
+                Section& section = GetWritableSection(y);
+                section.LoadBlockLight(nullptr);
+                section.LoadSkyLight(nullptr);
+            }
+        }
+    }
 
-#if USE_GUI
-        modified_since_last_rendered = true;
-#endif
-	}
+#if PROTOCOL_VERSION < 358
+    const unsigned char Chunk::GetBiome(const int x, const int z) const
+    {
+        if (x < 0 || x > CHUNK_WIDTH - 1 || z < 0 || z > CHUNK_WIDTH - 1)
+        {
+            return 0;
+        }
 
-#elif PROTOCOL_VERSION < 552
-	const int Chunk::GetBiome(const int x, const int z) const
-	{
-		if (x < 0 || x > CHUNK_WIDTH - 1 || z < 0 || z > CHUNK_WIDTH - 1)
-		{
-			return 0;
-		}
+        return static_cast<unsigned char>(GetBiomeEntry(z * CHUNK_WIDTH + x)->id);
+    }
 
-		return biomes[z * CHUNK_WIDTH + x];
-	}
+    void Chunk::SetBiome(const int x, const int z, const unsigned char b)
+    {
+        if (x < 0 || x > CHUNK_WIDTH - 1 || z < 0 || z > CHUNK_WIDTH - 1)
+        {
+            return;
+        }
 
-	void Chunk::SetBiome(const int x, const int z, const int b)
-	{
-		if (x < 0 || x > CHUNK_WIDTH - 1 || z < 0 || z > CHUNK_WIDTH - 1)
-		{
-			return;
-		}
+        SetBiomeCell(z * CHUNK_WIDTH + x, b);
+    }
 
-		biomes[z * CHUNK_WIDTH + x] = b;
+#elif PROTOCOL_VERSION < 552
+    const int Chunk::GetBiome(const int x, const int z) const
+    {
+        if (x < 0 || x > CHUNK_WIDTH - 1 || z < 0 || z > CHUNK_WIDTH - 1)
+        {
+            return 0;
+        }
 
-#if USE_GUI
-        modified_since_last_rendered = true;
-#endif
-	}
-#else
-	const int Chunk::GetBiome(const int x, const int y, const int z) const
-	{
-		return GetBiome(((y >> 2) & 63) << 4 | ((z >> 2) & 3) << 2 | ((x >> 2) & 3));
-	}
-
-	const int Chunk::GetBiome(const int i) const
-	{
-		if (i < 0 || i > BIOMES_SIZE - 1)
-		{
-			return 0;
-		}
-
-		return biomes[i];
-	}
-
-	void Chunk::SetBiomes(const std::vector<int>& new_biomes)
-	{
-		if (new_biomes.size() != BIOMES_SIZE)
-		{
-			std::cerr << "Warning, trying to set biomes with a wrong size" << std::endl;
-			return;
-		}
-		biomes = new_biomes;
+        return GetBiomeEntry(z * CHUNK_WIDTH + x)->id;
+    }
 
-#if USE_GUI
-        modified_since_last_rendered = true;
-#endif
-	}
+    void Chunk::SetBiome(const int x, const int z, const int b)
+    {
+        if (x < 0 || x > CHUNK_WIDTH - 1 || z < 0 || z > CHUNK_WIDTH - 1)
+        {
+            return;
+        }
 
-	void Chunk::SetBiome(const int x, const int y, const int z, const int new_biome)
-	{
-		SetBiome(((y >> 2) & 63) << 4 | ((z >> 2) & 3) << 2 | ((x >> 2) & 3), new_biome);
-	}
+        SetBiomeCell(z * CHUNK_WIDTH + x, b);
+    }
+#else
+    const int Chunk::GetBiome(const int x, const int y, const int z) const
+    {
+        return GetBiome(((y - min_y) >> 2) << 4 | ((z >> 2) & 3) << 2 | ((x >> 2) & 3));
+    }
 
-	void Chunk::SetBiome(const int i, const int new_biome)
-	{
-		if (i < 0 || i > BIOMES_SIZE - 1)
-		{
-			return;
-		}
+    const int Chunk::GetBiome(const int i) const
+    {
+        const BiomePaletteEntry* entry = GetBiomeEntry(i);
+        return entry == nullptr ? 0 : entry->id;
+    }
 
-		biomes[i] = new_biome;
+    void Chunk::SetBiomes(const std::vector<int>& new_biomes)
+    {
+        if (new_biomes.size() != num_biome_cells)
+        {
+            std::cerr << "Warning, trying to set biomes with a wrong size" << std::endl;
+            return;
+        }
+        LoadBiomes(new_biomes);
+    }
 
-#if USE_GUI
-        modified_since_last_rendered = true;
+    void Chunk::SetBiome(const int x, const int y, const int z, const int new_biome)
+    {
+        SetBiome(((y - min_y) >> 2) << 4 | ((z >> 2) & 3) << 2 | ((x >> 2) & 3), new_biome);
+    }
+
+    void Chunk::SetBiome(const int i, const int new_biome)
+    {
+        SetBiomeCell(i, new_biome);
+    }
 #endif
-	}
+
+#if PROTOCOL_VERSION < 552
+    const Biome* Chunk::GetBiomePtr(const int x, const int z) const
+    {
+        if (x < 0 || x > CHUNK_WIDTH - 1 || z < 0 || z > CHUNK_WIDTH - 1)
+        {
+            return nullptr;
+        }
+
+        return GetBiomeEntry(z * CHUNK_WIDTH + x)->biome;
+    }
+#else
+    const Biome* Chunk::GetBiomePtr(const int x, const int y, const int z) const
+    {
+        const BiomePaletteEntry* entry = GetBiomeEntry(((y - min_y) >> 2) << 4 | ((z >> 2) & 3) << 2 | ((x >> 2) & 3));
+        return entry == nullptr ? nullptr : entry->biome;
+    }
 #endif
 
-    std::shared_ptr<NBT> Chunk::GetBlockEntityData(const Position &pos)
+    const Chunk::BiomePaletteEntry* Chunk::GetBiomeEntry(const int i) const
     {
-        auto it = block_entities_data.find(pos);
-        if (it == block_entities_data.end())
+        if (i < 0 || i > num_biome_cells - 1)
         {
             return nullptr;
         }
 
-        return it->second;
+        // Uniform chunk, no need to look at the indices
+        if (biome_indices.empty())
+        {
+            return &biome_palette[0];
+        }
+
+        return &biome_palette[biome_indices[i]];
     }
 
-    void Chunk::UpdateNeighbour(const std::shared_ptr<Chunk> neighbour, const Orientation direction)
+    void Chunk::SetBiomeCell(const int i, const int id)
     {
-        Position this_dest_position = Position(0, 0, 0);
-        Position this_src_position = Position(0, 0, 0);
-        Position neighbour_dest_position = Position(0, 0, 0);
-        Position neighbour_src_position = Position(0, 0, 0);
-        switch (direction)
+        if (i < 0 || i > num_biome_cells - 1)
         {
-            // The neighbour is on "the left" on the x axis
-        case Orientation::West:
-            this_dest_position.x = -1;
-            this_src_position.x = 0;
-            neighbour_src_position.x = CHUNK_WIDTH - 1;
-            neighbour_dest_position.x = CHUNK_WIDTH;
+            return;
+        }
 
-            for (int y = 0; y < CHUNK_HEIGHT; ++y)
+        if (GetBiomeEntry(i)->id == id)
+        {
+            return;
+        }
+
+        int palette_index = -1;
+        for (int j = 0; j < biome_palette.size(); ++j)
+        {
+            if (biome_palette[j].id == id)
             {
-                this_dest_position.y = y;
-                this_src_position.y = y;
-                neighbour_src_position.y = y;
-                neighbour_dest_position.y = y;
-                for (int z = 0; z < CHUNK_WIDTH; ++z)
-                {
-                    this_dest_position.z = z;
-                    this_src_position.z = z;
-                    neighbour_src_position.z = z;
-                    neighbour_dest_position.z = z;
-                    // If the neighbour chunk is not loaded, just add air instead
-                    if (neighbour == nullptr)
-                    {
-                        SetBlock(this_dest_position, nullptr);
-                    }
-                    // Otherwise, get the blocks and set this chunk's blocks
-                    // on the neighbour
-                    else
-                    {
-                        SetBlock(this_dest_position, neighbour->GetBlock(neighbour_src_position));
-                        neighbour->SetBlock(neighbour_dest_position, GetBlock(this_src_position));
-                    }
-                }
+                palette_index = j;
+                break;
+            }
+        }
+
+        if (palette_index == -1)
+        {
+            if (biome_palette.size() > MAX_BIOME_PALETTE_INDEX)
+            {
+                std::cerr << "Warning, too many different biomes in chunk, biome ignored" << std::endl;
+                return;
             }
-            break;
-            // The neighbour is on "the right" on the x axis
-        case Orientation::East:
-            this_dest_position.x = CHUNK_WIDTH;
-            this_src_position.x = CHUNK_WIDTH - 1;
-            neighbour_src_position.x = 0;
-            neighbour_dest_position.x = -1;
-
-            for (int y = 0; y < CHUNK_HEIGHT; ++y)
-            {
-                this_dest_position.y = y;
-                this_src_position.y = y;
-                neighbour_src_position.y = y;
-                neighbour_dest_position.y = y;
-                for (int z = 0; z < CHUNK_WIDTH; ++z)
+            biome_palette.push_back(BiomePaletteEntry{ id, ResolveBiome(id) });
+            palette_index = static_cast<int>(biome_palette.size()) - 1;
+        }
+
+        if (biome_indices.empty())
+        {
+            biome_indices = std::vector<unsigned char>(num_biome_cells, 0);
+        }
+        biome_indices[i] = static_cast<unsigned char>(palette_index);
+
+#if USE_GUI
+        modified_since_last_rendered = true;
+#endif
+    }
+
+    void Chunk::ResetBiomes()
+    {
+#if PROTOCOL_VERSION < 552
+        num_biome_cells = CHUNK_WIDTH * CHUNK_WIDTH;
+#else
+        // One biome per 4x4x4 cube
+        num_biome_cells = (CHUNK_WIDTH / 4) * (CHUNK_WIDTH / 4) * (height / 4);
+#endif
+        biome_palette = { BiomePaletteEntry{ 0, ResolveBiome(0) } };
+        biome_indices.clear();
+    }
+
+    void Chunk::LoadBiomes(const std::vector<int>& ids)
+    {
+        biome_palette.clear();
+        biome_indices = std::vector<unsigned char>(num_biome_cells, 0);
+
+        int last_index = -1;
+        for (int i = 0; i < num_biome_cells; ++i)
+        {
+            // Consecutive cells usually have the same biome
+            if (last_index != -1 && biome_palette[last_index].id == ids[i])
+            {
+                biome_indices[i] = static_cast<unsigned char>(last_index);
+                continue;
+            }
+
+            last_index = -1;
+            for (int j = 0; j < biome_palette.size(); ++j)
+            {
+                if (biome_palette[j].id == ids[i])
                 {
-                    this_dest_position.z = z;
-                    this_src_position.z = z;
-                    neighbour_src_position.z = z;
-                    neighbour_dest_position.z = z;
-                    // If the neighbour chunk is not loaded, just add air instead
-                    if (neighbour == nullptr)
-                    {
-                        SetBlock(this_dest_position, nullptr);
-                    }
-                    // Otherwise, get the blocks and set this chunk's blocks
-                    // on the neighbour
-                    else
-                    {
-                        SetBlock(this_dest_position, neighbour->GetBlock(neighbour_src_position));
-                        neighbour->SetBlock(neighbour_dest_position, GetBlock(this_src_position));
-                    }
+                    last_index = j;
+                    break;
                 }
             }
-            break;
-            // The neighbour is on "the left" on the z axis
-        case Orientation::North:
-            this_dest_position.z = -1;
-            this_src_position.z = 0;
-            neighbour_src_position.z = CHUNK_WIDTH - 1;
-            neighbour_dest_position.z = CHUNK_WIDTH;
-
-            for (int y = 0; y < CHUNK_HEIGHT; ++y)
-            {
-                this_dest_position.y = y;
-                this_src_position.y = y;
-                neighbour_src_position.y = y;
-                neighbour_dest_position.y = y;
-                for (int x = 0; x < CHUNK_WIDTH; ++x)
+
+            if (last_index == -1)
+            {
+                if (biome_palette.size() > MAX_BIOME_PALETTE_INDEX)
                 {
-                    this_dest_position.x = x;
-                    this_src_position.x = x;
-                    neighbour_src_position.x = x;
-                    neighbour_dest_position.x = x;
-                    // If the neighbour chunk is not loaded, just add air instead
-                    if (neighbour == nullptr)
-                    {
-                        SetBlock(this_dest_position, nullptr);
-                    }
-                    // Otherwise, get the blocks and set this chunk's blocks
-                    // on the neighbour
-                    else
-                    {
-                        SetBlock(this_dest_position, neighbour->GetBlock(neighbour_src_position));
-                        neighbour->SetBlock(neighbour_dest_position, GetBlock(this_src_position));
-                    }
+                    std::cerr << "Warning, too many different biomes in chunk, biome ignored" << std::endl;
+                    last_index = 0;
                 }
-            }
-            break;
-            // The neighbour is on "the right" on the z axis
-        case Orientation::South:
-            this_dest_position.z = CHUNK_WIDTH;
-            this_src_position.z = CHUNK_WIDTH - 1;
-            neighbour_src_position.z = 0;
-            neighbour_dest_position.z = -1;
-
-            for (int y = 0; y < CHUNK_HEIGHT; ++y)
-            {
-                this_dest_position.y = y;
-                this_src_position.y = y;
-                neighbour_src_position.y = y;
-                neighbour_dest_position.y = y;
-                for (int x = 0; x < CHUNK_WIDTH; ++x)
+                else
                 {
-                    this_dest_position.x = x;
-                    this_src_position.x = x;
-                    neighbour_src_position.x = x;
-                    neighbour_dest_position.x = x;
-                    // If the neighbour chunk is not loaded, just add air instead
-                    if (neighbour == nullptr)
-                    {
-                        SetBlock(this_dest_position, nullptr);
-                    }
-                    // Otherwise, get the blocks and set this chunk's blocks
-                    // on the neighbour
-                    else
-                    {
-                        SetBlock(this_dest_position, neighbour->GetBlock(neighbour_src_position));
-                        neighbour->SetBlock(neighbour_dest_position, GetBlock(this_src_position));
-                    }
+                    biome_palette.push_back(BiomePaletteEntry{ ids[i], ResolveBiome(ids[i]) });
+                    last_index = static_cast<int>(biome_palette.size()) - 1;
                 }
             }
-            break;
-        default:
-            break;
+            biome_indices[i] = static_cast<unsigned char>(last_index);
+        }
+
+        if (biome_palette.empty())
+        {
+            biome_palette.push_back(BiomePaletteEntry{ 0, ResolveBiome(0) });
+        }
+
+        if (biome_palette.size() == 1)
+        {
+            biome_indices.clear();
+            biome_indices.shrink_to_fit();
+        }
+
+#if USE_GUI
+        modified_since_last_rendered = true;
+#endif
+    }
+
+    std::shared_ptr<const NBT> Chunk::GetBlockEntityData(const Position &pos) const
+    {
+        if (pos.x < 0 || pos.x > CHUNK_WIDTH - 1 || pos.y < min_y || pos.y > min_y + height - 1 || pos.z < 0 || pos.z > CHUNK_WIDTH - 1)
+        {
+            return nullptr;
+        }
+
+        return block_entities_data.Get(BlockEntityStore::PackIndex(pos.x, pos.y - min_y, pos.z));
+    }
+
+    void Chunk::SetBlockEntityData(const Position& pos, const NBT& data)
+    {
+        if (pos.x < 0 || pos.x > CHUNK_WIDTH - 1 || pos.y < min_y || pos.y > min_y + height - 1 || pos.z < 0 || pos.z > CHUNK_WIDTH - 1)
+        {
+            return;
+        }
+
+        const int index = BlockEntityStore::PackIndex(pos.x, pos.y - min_y, pos.z);
+        if (data.HasData())
+        {
+            block_entities_data.Set(index, std::make_shared<const NBT>(data));
+        }
+        else
+        {
+            block_entities_data.Erase(index);
         }
     }
 
@@ -729,23 +1033,174 @@ namespace Botcraft
         return dimension;
     }
 
-    std::map<Position, std::shared_ptr<NBT> >& Chunk::GetBlockEntitiesData()
+    const size_t Chunk::GetDataHash() const
     {
-        return block_entities_data;
+        return data_hash;
+    }
+
+    void Chunk::SetDataHash(const size_t hash)
+    {
+        data_hash = hash;
+    }
+
+    const size_t Chunk::GetMemoryUsage() const
+    {
+        return memory_usage;
     }
 
-    const std::map<Position, std::shared_ptr<NBT> >& Chunk::GetBlockEntitiesData() const
+    void Chunk::UpdateMemoryUsage()
+    {
+        size_t usage = sizeof(Chunk) +
+            sections.capacity() * sizeof(std::shared_ptr<Section>) +
+            biome_palette.capacity() * sizeof(BiomePaletteEntry) +
+            biome_indices.capacity() +
+            block_entities_data.size() * (sizeof(BlockEntityStore::value_type) + sizeof(NBT));
+
+        for (int i = 0; i < sections.size(); ++i)
+        {
+            if (sections[i])
+            {
+                usage += sections[i]->GetMemoryUsage();
+            }
+        }
+
+        memory_usage = usage;
+    }
+
+    const size_t Chunk::GetSectionMemoryUsage(const int section_y) const
+    {
+        if (section_y < 0 || section_y >= sections.size() || sections[section_y] == nullptr)
+        {
+            return 0;
+        }
+
+        return sections[section_y]->GetMemoryUsage();
+    }
+
+    void Chunk::UpdateSectionMemoryUsage(const int section_y, const size_t old_section_usage)
+    {
+        memory_usage = memory_usage - old_section_usage + GetSectionMemoryUsage(section_y);
+    }
+
+    void Chunk::Serialize(WriteContainer& container) const
+    {
+        WriteData<int>(min_y, container);
+        WriteData<int>(height, container);
+        WriteData<unsigned long long int>(data_hash, container);
+
+        WriteData<VarInt>(static_cast<int>(sections.size()), container);
+        for (int i = 0; i < sections.size(); ++i)
+        {
+            WriteData<bool>(sections[i] != nullptr, container);
+            if (sections[i])
+            {
+                sections[i]->Serialize(container);
+            }
+        }
+
+        WriteData<VarInt>(num_biome_cells, container);
+        for (int i = 0; i < num_biome_cells; ++i)
+        {
+#if PROTOCOL_VERSION < 358
+            WriteData<unsigned char>(GetBiomeEntry(i)->id, container);
+#else
+            WriteData<int>(GetBiomeEntry(i)->id, container);
+#endif
+        }
+
+        WriteData<VarInt>(static_cast<int>(block_entities_data.size()), container);
+        for (auto it = block_entities_data.begin(); it != block_entities_data.end(); ++it)
+        {
+            it->second->Write(container);
+        }
+    }
+
+    void Chunk::Deserialize(ReadIterator& iter, size_t& length)
+    {
+        const int new_min_y = ReadData<int>(iter, length);
+        const int new_height = ReadData<int>(iter, length);
+        if (new_min_y % SECTION_HEIGHT != 0 || new_height % SECTION_HEIGHT != 0 || new_height <= 0)
+        {
+            throw(std::runtime_error("Wrong height in serialized chunk"));
+        }
+        min_y = new_min_y;
+        height = new_height;
+        // The number of biome cells depends on the height
+        ResetBiomes();
+        data_hash = static_cast<size_t>(ReadData<unsigned long long int>(iter, length));
+
+        const int num_sections = ReadData<VarInt>(iter, length);
+        if (num_sections < 0 || num_sections > height / SECTION_HEIGHT)
+        {
+            throw(std::runtime_error("Wrong number of sections in serialized chunk"));
+        }
+        sections = std::vector<std::shared_ptr<Section> >(num_sections);
+        for (int i = 0; i < num_sections; ++i)
+        {
+            if (ReadData<bool>(iter, length))
+            {
+                AddSection(i);
+                sections[i]->Deserialize(iter, length);
+            }
+        }
+
+        const int biomes_size = ReadData<VarInt>(iter, length);
+        if (biomes_size != num_biome_cells || biomes_size > length)
+        {
+            throw(std::runtime_error("Wrong biomes size in serialized chunk"));
+        }
+        std::vector<int> serialized_biomes(biomes_size);
+        for (int i = 0; i < biomes_size; ++i)
+        {
+#if PROTOCOL_VERSION < 358
+            serialized_biomes[i] = ReadData<unsigned char>(iter, length);
+#else
+            serialized_biomes[i] = ReadData<int>(iter, length);
+#endif
+        }
+        LoadBiomes(serialized_biomes);
+
+        const int num_block_entities = ReadData<VarInt>(iter, length);
+        if (num_block_entities < 0 || num_block_entities > length)
+        {
+            throw(std::runtime_error("Wrong number of block entities in serialized chunk"));
+        }
+        std::vector<NBT> block_entities(num_block_entities);
+        for (int i = 0; i < num_block_entities; ++i)
+        {
+            block_entities[i].Read(iter, length);
+        }
+        LoadChunkBlockEntitiesData(block_entities);
+
+        ComputeHeightmaps();
+
+#if USE_GUI
+        modified_since_last_rendered = true;
+#endif
+    }
+
+    const BlockEntityStore& Chunk::GetBlockEntitiesData() const
     {
         return block_entities_data;
     }
 
     const bool Chunk::HasSection(const int y) const
     {
-        return sections[y] != nullptr;
+        return y >= 0 && y < sections.size() && sections[y] != nullptr;
     }
 
     void Chunk::AddSection(const int y)
     {
+        if (y < 0 || y > height / SECTION_HEIGHT - 1)
+        {
+            return;
+        }
+
+        if (y >= sections.size())
+        {
+            sections.resize(y + 1);
+        }
+
 #if PROTOCOL_VERSION < 719
         sections[y] = std::shared_ptr<Section>(new Section(dimension == Dimension::Overworld));
 #else
@@ -753,4 +1208,19 @@ namespace Botcraft
 #endif
     }
 
+    Section& Chunk::GetWritableSection(const int y)
+    {
+        if (sections[y].use_count() > 1)
+        {
+            sections[y] = std::shared_ptr<Section>(new Section(*sections[y]));
+        }
+        else
+        {
+            // The last other owner may have been released on another
+            // thread, make sure its reads happened before our writes
+            std::atomic_thread_fence(std::memory_order_acquire);
+        }
+        return *sections[y];
+    }
+
 } //Botcraft
\ No newline at end of file
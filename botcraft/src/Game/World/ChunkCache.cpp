@@ -0,0 +1,474 @@
+#include "botcraft/Game/World/ChunkCache.hpp"
+#include "botcraft/Game/World/Chunk.hpp"
+
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <filesystem>
+#include <cstring>
+#include <stdexcept>
+
+#ifdef USE_COMPRESSION
+#include <zlib.h>
+#endif
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace Botcraft
+{
+    static const int REGION_WIDTH = 32;
+    static const int REGION_SIZE = REGION_WIDTH * REGION_WIDTH;
+    static const size_t SECTOR_SIZE = 4096;
+    // Regions are dropped (and their files unmapped)
+    // when more than this number are opened
+    static const size_t MAX_OPEN_REGIONS = 64;
+
+    // Location of one chunk in a region file. The header of the file
+    // is REGION_SIZE entries, stored in host byte order
+    struct RegionEntry
+    {
+        // In sectors from the beginning of the file, 0 if there is no chunk
+        unsigned int sector_offset;
+        unsigned int sector_count;
+        unsigned int stored_size;
+        // Size of the data once uncompressed, 0 if stored uncompressed
+        unsigned int raw_size;
+        unsigned long long int data_hash;
+    };
+    static_assert(sizeof(RegionEntry) == 24, "RegionEntry must not have padding");
+
+    static const size_t HEADER_SIZE = REGION_SIZE * sizeof(RegionEntry);
+    static const unsigned int HEADER_SECTORS = static_cast<unsigned int>((HEADER_SIZE + SECTOR_SIZE - 1) / SECTOR_SIZE);
+
+    // Read only memory mapping of a whole file
+    class MappedFile
+    {
+    public:
+        MappedFile()
+        {
+            ptr = nullptr;
+            length = 0;
+#ifdef _WIN32
+            file_handle = INVALID_HANDLE_VALUE;
+            mapping_handle = NULL;
+#endif
+        }
+
+        ~MappedFile()
+        {
+            Unmap();
+        }
+
+        bool Map(const std::string& path)
+        {
+            Unmap();
+#ifdef _WIN32
+            file_handle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+            if (file_handle == INVALID_HANDLE_VALUE)
+            {
+                return false;
+            }
+            LARGE_INTEGER file_size;
+            if (!GetFileSizeEx(file_handle, &file_size) || file_size.QuadPart == 0)
+            {
+                Unmap();
+                return false;
+            }
+            mapping_handle = CreateFileMappingA(file_handle, NULL, PAGE_READONLY, 0, 0, NULL);
+            if (mapping_handle == NULL)
+            {
+                Unmap();
+                return false;
+            }
+            ptr = static_cast<const unsigned char*>(MapViewOfFile(mapping_handle, FILE_MAP_READ, 0, 0, 0));
+            if (ptr == nullptr)
+            {
+                Unmap();
+                return false;
+            }
+            length = static_cast<size_t>(file_size.QuadPart);
+#else
+            const int fd = open(path.c_str(), O_RDONLY);
+            if (fd < 0)
+            {
+                return false;
+            }
+            struct stat file_stat;
+            if (fstat(fd, &file_stat) != 0 || file_stat.st_size == 0)
+            {
+                close(fd);
+                return false;
+            }
+            void* mapped = mmap(nullptr, file_stat.st_size, PROT_READ, MAP_SHARED, fd, 0);
+            // The mapping stays valid after the file is closed
+            close(fd);
+            if (mapped == MAP_FAILED)
+            {
+                return false;
+            }
+            ptr = static_cast<const unsigned char*>(mapped);
+            length = static_cast<size_t>(file_stat.st_size);
+#endif
+            return true;
+        }
+
+        void Unmap()
+        {
+#ifdef _WIN32
+            if (ptr != nullptr)
+            {
+                UnmapViewOfFile(ptr);
+            }
+            if (mapping_handle != NULL)
+            {
+                CloseHandle(mapping_handle);
+                mapping_handle = NULL;
+            }
+            if (file_handle != INVALID_HANDLE_VALUE)
+            {
+                CloseHandle(file_handle);
+                file_handle = INVALID_HANDLE_VALUE;
+            }
+#else
+            if (ptr != nullptr)
+            {
+                munmap(const_cast<unsigned char*>(ptr), length);
+            }
+#endif
+            ptr = nullptr;
+            length = 0;
+        }
+
+        const unsigned char* data() const
+        {
+            return ptr;
+        }
+
+        const size_t size() const
+        {
+            return length;
+        }
+
+    private:
+        const unsigned char* ptr;
+        size_t length;
+#ifdef _WIN32
+        HANDLE file_handle;
+        HANDLE mapping_handle;
+#endif
+    };
+
+    struct ChunkCache::Region
+    {
+        std::string path;
+        // Copy of the file header
+        RegionEntry entries[REGION_SIZE];
+        // Size of the file in sectors
+        unsigned int num_sectors;
+        // Only mapped when reading, and unmapped
+        // before any modification of the file
+        MappedFile mapping;
+    };
+
+#if PROTOCOL_VERSION < 719
+    static const std::string DimensionFolderName(const Dimension dim)
+    {
+        return "DIM" + std::to_string(static_cast<int>(dim));
+    }
+#else
+    static const std::string DimensionFolderName(const std::string& dim)
+    {
+        std::string output = dim;
+        for (int i = 0; i < output.size(); ++i)
+        {
+            if (output[i] == ':' || output[i] == '/' || output[i] == '\\')
+            {
+                output[i] = '_';
+            }
+        }
+        return output;
+    }
+#endif
+
+    static const int ChunkIndexInRegion(const int x, const int z)
+    {
+        return (z & (REGION_WIDTH - 1)) * REGION_WIDTH + (x & (REGION_WIDTH - 1));
+    }
+
+    ChunkCache::ChunkCache(const std::string& folder_)
+    {
+        folder = folder_ + "/" + std::to_string(PROTOCOL_VERSION);
+        std::error_code ec;
+        std::filesystem::create_directories(folder, ec);
+        if (ec)
+        {
+            std::cerr << "Warning, can't create chunk cache folder " << folder << ": " << ec.message() << std::endl;
+        }
+    }
+
+    ChunkCache::~ChunkCache()
+    {
+
+    }
+
+#if PROTOCOL_VERSION < 719
+    bool ChunkCache::Save(const Dimension dim, const int x, const int z, const Chunk& chunk)
+#else
+    bool ChunkCache::Save(const std::string& dim, const int x, const int z, const Chunk& chunk)
+#endif
+    {
+        return SaveImpl(DimensionFolderName(dim), x, z, chunk);
+    }
+
+#if PROTOCOL_VERSION < 719
+    std::shared_ptr<Chunk> ChunkCache::Load(const Dimension dim, const int x, const int z)
+#else
+    std::shared_ptr<Chunk> ChunkCache::Load(const std::string& dim, const int x, const int z)
+#endif
+    {
+        std::shared_ptr<Chunk> chunk = std::shared_ptr<Chunk>(new Chunk(CHUNK_MIN_Y, CHUNK_HEIGHT, dim));
+        if (!LoadImpl(DimensionFolderName(dim), x, z, *chunk))
+        {
+            return nullptr;
+        }
+        return chunk;
+    }
+
+#if PROTOCOL_VERSION < 719
+    const size_t ChunkCache::GetDataHash(const Dimension dim, const int x, const int z)
+#else
+    const size_t ChunkCache::GetDataHash(const std::string& dim, const int x, const int z)
+#endif
+    {
+        return GetDataHashImpl(DimensionFolderName(dim), x, z);
+    }
+
+    bool ChunkCache::SaveImpl(const std::string& dim_name, const int x, const int z, const Chunk& chunk)
+    {
+        // Serialize and compress before locking the cache
+        std::vector<unsigned char> raw;
+        chunk.Serialize(raw);
+
+        std::vector<unsigned char> stored;
+        unsigned int raw_size = 0;
+#ifdef USE_COMPRESSION
+        unsigned long compressed_size = compressBound(static_cast<unsigned long>(raw.size()));
+        stored.resize(compressed_size);
+        if (compress2(stored.data(), &compressed_size, raw.data(), static_cast<unsigned long>(raw.size()), Z_BEST_SPEED) == Z_OK)
+        {
+            stored.resize(compressed_size);
+            raw_size = static_cast<unsigned int>(raw.size());
+        }
+        else
+        {
+            stored = std::move(raw);
+        }
+#else
+        stored = std::move(raw);
+#endif
+
+        std::lock_guard<std::mutex> lock(cache_mutex);
+        Region* region = GetRegion(dim_name, x >> 5, z >> 5, true);
+        if (region == nullptr)
+        {
+            return false;
+        }
+
+        // The file is going to be modified
+        region->mapping.Unmap();
+
+        RegionEntry& entry = region->entries[ChunkIndexInRegion(x, z)];
+        const unsigned int needed_sectors = static_cast<unsigned int>((stored.size() + SECTOR_SIZE - 1) / SECTOR_SIZE);
+
+        RegionEntry new_entry;
+        // Overwrite the previous version if the new one fits, else
+        // append it at the end of the file. Space used by the previous
+        // version is lost until the file is deleted
+        new_entry.sector_offset = (entry.sector_offset != 0 && entry.sector_count >= needed_sectors) ? entry.sector_offset : region->num_sectors;
+        new_entry.sector_count = needed_sectors;
+        new_entry.stored_size = static_cast<unsigned int>(stored.size());
+        new_entry.raw_size = raw_size;
+        new_entry.data_hash = chunk.GetDataHash();
+
+        std::fstream file(region->path, std::ios::in | std::ios::out | std::ios::binary);
+        if (!file.is_open())
+        {
+            std::cerr << "Warning, can't open chunk cache file " << region->path << std::endl;
+            return false;
+        }
+
+        // Pad the data so the file always ends on a sector boundary
+        stored.resize(static_cast<size_t>(needed_sectors) * SECTOR_SIZE, 0);
+        file.seekp(static_cast<std::streamoff>(new_entry.sector_offset) * SECTOR_SIZE);
+        file.write(reinterpret_cast<const char*>(stored.data()), stored.size());
+        file.seekp(static_cast<std::streamoff>(ChunkIndexInRegion(x, z)) * sizeof(RegionEntry));
+        file.write(reinterpret_cast<const char*>(&new_entry), sizeof(RegionEntry));
+        file.flush();
+
+        if (!file.good())
+        {
+            std::cerr << "Warning, error while writing chunk cache file " << region->path << std::endl;
+            return false;
+        }
+
+        region->num_sectors = std::max(region->num_sectors, new_entry.sector_offset + new_entry.sector_count);
+        entry = new_entry;
+        return true;
+    }
+
+    bool ChunkCache::LoadImpl(const std::string& dim_name, const int x, const int z, Chunk& chunk)
+    {
+        std::vector<unsigned char> raw;
+        {
+            std::lock_guard<std::mutex> lock(cache_mutex);
+            Region* region = GetRegion(dim_name, x >> 5, z >> 5, false);
+            if (region == nullptr)
+            {
+                return false;
+            }
+
+            const RegionEntry& entry = region->entries[ChunkIndexInRegion(x, z)];
+            if (entry.sector_offset == 0)
+            {
+                return false;
+            }
+
+            if (region->mapping.data() == nullptr && !region->mapping.Map(region->path))
+            {
+                std::cerr << "Warning, can't map chunk cache file " << region->path << std::endl;
+                return false;
+            }
+
+            const size_t data_offset = static_cast<size_t>(entry.sector_offset) * SECTOR_SIZE;
+            if (data_offset + entry.stored_size > region->mapping.size())
+            {
+                std::cerr << "Warning, corrupted chunk cache file " << region->path << std::endl;
+                return false;
+            }
+            const unsigned char* stored = region->mapping.data() + data_offset;
+
+            if (entry.raw_size == 0)
+            {
+                raw = std::vector<unsigned char>(stored, stored + entry.stored_size);
+            }
+            else
+            {
+#ifdef USE_COMPRESSION
+                // Decompress straight from the mapped file
+                raw.resize(entry.raw_size);
+                unsigned long raw_size = entry.raw_size;
+                if (uncompress(raw.data(), &raw_size, stored, entry.stored_size) != Z_OK || raw_size != entry.raw_size)
+                {
+                    std::cerr << "Warning, can't decompress chunk " << x << ", " << z << " from chunk cache" << std::endl;
+                    return false;
+                }
+#else
+                std::cerr << "Warning, chunk cache data are compressed but compression is not enabled" << std::endl;
+                return false;
+#endif
+            }
+        }
+
+        try
+        {
+            ProtocolCraft::ReadIterator iter = raw.begin();
+            size_t length = raw.size();
+            chunk.Deserialize(iter, length);
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << "Warning, can't read chunk " << x << ", " << z << " from chunk cache: " << e.what() << std::endl;
+            return false;
+        }
+
+        return true;
+    }
+
+    const size_t ChunkCache::GetDataHashImpl(const std::string& dim_name, const int x, const int z)
+    {
+        std::lock_guard<std::mutex> lock(cache_mutex);
+        Region* region = GetRegion(dim_name, x >> 5, z >> 5, false);
+        if (region == nullptr)
+        {
+            return 0;
+        }
+
+        const RegionEntry& entry = region->entries[ChunkIndexInRegion(x, z)];
+        if (entry.sector_offset == 0)
+        {
+            return 0;
+        }
+
+        return static_cast<size_t>(entry.data_hash);
+    }
+
+    ChunkCache::Region* ChunkCache::GetRegion(const std::string& dim_name, const int region_x, const int region_z, const bool create)
+    {
+        const std::tuple<std::string, int, int> key(dim_name, region_x, region_z);
+        auto it = regions.find(key);
+        if (it != regions.end())
+        {
+            return it->second.get();
+        }
+
+        const std::string dim_folder = folder + "/" + dim_name;
+        const std::string path = dim_folder + "/r." + std::to_string(region_x) + "." + std::to_string(region_z) + ".bcr";
+
+        std::unique_ptr<Region> region = std::unique_ptr<Region>(new Region);
+        region->path = path;
+
+        std::ifstream file(path, std::ios::binary | std::ios::ate);
+        if (file.is_open())
+        {
+            const size_t file_size = static_cast<size_t>(file.tellg());
+            file.seekg(0);
+            if (file_size < HEADER_SIZE ||
+                !file.read(reinterpret_cast<char*>(region->entries), HEADER_SIZE))
+            {
+                std::cerr << "Warning, corrupted chunk cache file " << path << std::endl;
+                return nullptr;
+            }
+            region->num_sectors = static_cast<unsigned int>((file_size + SECTOR_SIZE - 1) / SECTOR_SIZE);
+        }
+        else
+        {
+            if (!create)
+            {
+                return nullptr;
+            }
+
+            std::error_code ec;
+            std::filesystem::create_directories(dim_folder, ec);
+
+            // Empty region, only the header
+            std::memset(region->entries, 0, HEADER_SIZE);
+            std::vector<char> header(static_cast<size_t>(HEADER_SECTORS) * SECTOR_SIZE, 0);
+            std::ofstream new_file(path, std::ios::binary);
+            if (!new_file.write(header.data(), header.size()))
+            {
+                std::cerr << "Warning, can't create chunk cache file " << path << std::endl;
+                return nullptr;
+            }
+            region->num_sectors = HEADER_SECTORS;
+        }
+
+        if (regions.size() >= MAX_OPEN_REGIONS)
+        {
+            regions.clear();
+        }
+
+        Region* output = region.get();
+        regions[key] = std::move(region);
+        return output;
+    }
+} // Botcraft
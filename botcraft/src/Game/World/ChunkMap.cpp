@@ -0,0 +1,176 @@
+#include "botcraft/Game/World/ChunkMap.hpp"
+
+namespace Botcraft
+{
+    // Must be a power of 2
+    static const size_t CHUNK_MAP_MIN_CAPACITY = 64;
+
+    ChunkMap::const_iterator::const_iterator(const std::vector<value_type>& slots_, const size_t index_)
+    {
+        slots = &slots_;
+        index = index_;
+        SkipEmpty();
+    }
+
+    const ChunkMap::value_type& ChunkMap::const_iterator::operator*() const
+    {
+        return (*slots)[index];
+    }
+
+    const ChunkMap::value_type* ChunkMap::const_iterator::operator->() const
+    {
+        return &(*slots)[index];
+    }
+
+    ChunkMap::const_iterator& ChunkMap::const_iterator::operator++()
+    {
+        index += 1;
+        SkipEmpty();
+        return *this;
+    }
+
+    const bool ChunkMap::const_iterator::operator==(const const_iterator& other) const
+    {
+        return slots == other.slots && index == other.index;
+    }
+
+    const bool ChunkMap::const_iterator::operator!=(const const_iterator& other) const
+    {
+        return !(*this == other);
+    }
+
+    void ChunkMap::const_iterator::SkipEmpty()
+    {
+        while (index < slots->size() && (*slots)[index].second == nullptr)
+        {
+            index += 1;
+        }
+    }
+
+
+    ChunkMap::ChunkMap()
+    {
+        Clear();
+    }
+
+    const std::shared_ptr<Chunk>& ChunkMap::Get(const int x, const int z) const
+    {
+        return slots[FindSlot(x, z)].second;
+    }
+
+    void ChunkMap::Set(const int x, const int z, const std::shared_ptr<Chunk>& chunk)
+    {
+        size_t index = FindSlot(x, z);
+        if (slots[index].second == nullptr)
+        {
+            // Keep the load factor under 0.5 so probe sequences stay short
+            if (2 * (num_elements + 1) > slots.size())
+            {
+                Grow();
+                index = FindSlot(x, z);
+            }
+            num_elements += 1;
+        }
+
+        slots[index].first = { x, z };
+        slots[index].second = chunk;
+    }
+
+    bool ChunkMap::Erase(const int x, const int z)
+    {
+        size_t index = FindSlot(x, z);
+        if (slots[index].second == nullptr)
+        {
+            return false;
+        }
+
+        slots[index].second = nullptr;
+        num_elements -= 1;
+
+        // Shift back the following elements of the probe sequence
+        // if the removed slot was on their way, so we don't need
+        // tombstones
+        const size_t mask = slots.size() - 1;
+        size_t empty_index = index;
+        size_t current_index = (index + 1) & mask;
+        while (slots[current_index].second != nullptr)
+        {
+            const size_t ideal_index = Hash(slots[current_index].first.first, slots[current_index].first.second) & mask;
+            // Distance from ideal slot to empty slot vs to current slot
+            if (((empty_index - ideal_index) & mask) < ((current_index - ideal_index) & mask))
+            {
+                slots[empty_index] = std::move(slots[current_index]);
+                slots[current_index].second = nullptr;
+                empty_index = current_index;
+            }
+            current_index = (current_index + 1) & mask;
+        }
+
+        return true;
+    }
+
+    void ChunkMap::Clear()
+    {
+        slots = std::vector<value_type>(CHUNK_MAP_MIN_CAPACITY);
+        num_elements = 0;
+    }
+
+    const size_t ChunkMap::size() const
+    {
+        return num_elements;
+    }
+
+    const bool ChunkMap::empty() const
+    {
+        return num_elements == 0;
+    }
+
+    ChunkMap::const_iterator ChunkMap::begin() const
+    {
+        return const_iterator(slots, 0);
+    }
+
+    ChunkMap::const_iterator ChunkMap::end() const
+    {
+        return const_iterator(slots, slots.size());
+    }
+
+    const size_t ChunkMap::Hash(const int x, const int z)
+    {
+        // splitmix64 finalizer on the packed coordinates
+        unsigned long long int h = static_cast<unsigned long long int>(static_cast<unsigned int>(x)) << 32 | static_cast<unsigned int>(z);
+        h ^= h >> 30;
+        h *= 0xbf58476d1ce4e5b9ULL;
+        h ^= h >> 27;
+        h *= 0x94d049bb133111ebULL;
+        h ^= h >> 31;
+        return static_cast<size_t>(h);
+    }
+
+    const size_t ChunkMap::FindSlot(const int x, const int z) const
+    {
+        const size_t mask = slots.size() - 1;
+        size_t index = Hash(x, z) & mask;
+        // The load factor is always < 1, so there is at least one empty slot
+        while (slots[index].second != nullptr &&
+            (slots[index].first.first != x || slots[index].first.second != z))
+        {
+            index = (index + 1) & mask;
+        }
+        return index;
+    }
+
+    void ChunkMap::Grow()
+    {
+        std::vector<value_type> old_slots = std::move(slots);
+        slots = std::vector<value_type>(old_slots.size() * 2);
+
+        for (size_t i = 0; i < old_slots.size(); ++i)
+        {
+            if (old_slots[i].second != nullptr)
+            {
+                slots[FindSlot(old_slots[i].first.first, old_slots[i].first.second)] = std::move(old_slots[i]);
+            }
+        }
+    }
+} // Botcraft
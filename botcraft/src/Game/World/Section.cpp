@@ -0,0 +1,602 @@
+#include "botcraft/Game/World/Section.hpp"
+
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+
+using namespace ProtocolCraft;
+
+namespace Botcraft
+{
+    static const int SECTION_STORAGE_SIZE = CHUNK_WIDTH * CHUNK_WIDTH * SECTION_HEIGHT;
+    static const unsigned char MIN_BITS_PER_ENTRY = 4;
+    static const unsigned char MAX_BITS_PER_ENTRY = 16;
+
+    // How light arrays are stored in the serialized sections
+    enum class SerializedLight : unsigned char
+    {
+        None,
+        Empty,
+        Full,
+        Data
+    };
+
+    // Light arrays shared by all the sections with uniform light
+    static const std::shared_ptr<LightData>& EmptyLight()
+    {
+        static const std::shared_ptr<LightData> empty_light = []()
+        {
+            std::shared_ptr<LightData> light = std::make_shared<LightData>();
+            light->fill(0x00);
+            return light;
+        }();
+        return empty_light;
+    }
+
+    static const std::shared_ptr<LightData>& FullLight()
+    {
+        static const std::shared_ptr<LightData> full_light = []()
+        {
+            std::shared_ptr<LightData> light = std::make_shared<LightData>();
+            light->fill(0xFF);
+            return light;
+        }();
+        return full_light;
+    }
+
+    Section::Section(const bool has_sky_light)
+    {
+        // Start with only air in the palette, all indices are 0
+        palette = { Block() };
+        bits_per_entry = MIN_BITS_PER_ENTRY;
+        data_blocks = std::vector<unsigned char>(SECTION_STORAGE_SIZE * bits_per_entry / 8, 0);
+        indexed_blocks.fill(0);
+
+        block_light = EmptyLight();
+        sky_light = has_sky_light ? EmptyLight() : nullptr;
+    }
+
+    const int Section::GetBlockIndex(const int x, const int y, const int z)
+    {
+        return ToSectionBlockIndex(x, y, z);
+    }
+
+    const Block* Section::GetBlock(const int index) const
+    {
+        return palette.data() + GetPaletteIndex(index);
+    }
+
+    void Section::SetBlock(const int index, const Block& block)
+    {
+        if (palette[GetPaletteIndex(index)] == block)
+        {
+            return;
+        }
+
+        SetPaletteIndex(index, AddToPalette(block));
+    }
+
+    void Section::LoadBlocks(const std::vector<Block>& blocks_palette, const unsigned short* indices)
+    {
+        bits_per_entry = MIN_BITS_PER_ENTRY;
+        while (bits_per_entry < MAX_BITS_PER_ENTRY && blocks_palette.size() > (1 << bits_per_entry))
+        {
+            bits_per_entry *= 2;
+        }
+        data_blocks = std::vector<unsigned char>(SECTION_STORAGE_SIZE * bits_per_entry / 8, 0);
+        palette = blocks_palette;
+
+        // Storage order is the same as the network one
+        for (int i = 0; i < SECTION_STORAGE_SIZE; ++i)
+        {
+            SetPaletteIndex(i, indices[i]);
+        }
+    }
+
+    const unsigned char Section::GetBitsPerEntry() const
+    {
+        return bits_per_entry;
+    }
+
+    const size_t Section::GetPaletteSize() const
+    {
+        return palette.size();
+    }
+
+    const size_t Section::GetMemoryUsage() const
+    {
+        size_t usage = sizeof(Section) +
+            palette.capacity() * sizeof(Block) +
+            data_blocks.capacity();
+
+        if (block_light && block_light.use_count() == 1)
+        {
+            usage += sizeof(LightData);
+        }
+        if (sky_light && sky_light.use_count() == 1)
+        {
+            usage += sizeof(LightData);
+        }
+
+        return usage;
+    }
+
+    const unsigned char Section::GetBlockLight(const int index) const
+    {
+        return ((*block_light)[index >> 1] >> ((index & 1) << 2)) & 0x0F;
+    }
+
+    void Section::SetBlockLight(const int index, const unsigned char v)
+    {
+        SetLight(block_light, index, v);
+    }
+
+    const unsigned char Section::GetSkyLight(const int index) const
+    {
+        if (sky_light == nullptr)
+        {
+            return 0;
+        }
+        return ((*sky_light)[index >> 1] >> ((index & 1) << 2)) & 0x0F;
+    }
+
+    void Section::SetSkyLight(const int index, const unsigned char v)
+    {
+        if (sky_light == nullptr)
+        {
+            return;
+        }
+        SetLight(sky_light, index, v);
+    }
+
+    const bool Section::HasSkyLight() const
+    {
+        return sky_light != nullptr;
+    }
+
+    void Section::LoadBlockLight(const unsigned char* data)
+    {
+        LoadLight(block_light, data);
+    }
+
+    void Section::LoadSkyLight(const unsigned char* data)
+    {
+        if (sky_light == nullptr)
+        {
+            return;
+        }
+        LoadLight(sky_light, data);
+    }
+
+    void Section::CopyLight(const Section& other)
+    {
+        block_light = other.block_light;
+        if (sky_light != nullptr && other.sky_light != nullptr)
+        {
+            sky_light = other.sky_light;
+        }
+    }
+
+    void Section::LoadLight(std::shared_ptr<LightData>& light, const unsigned char* data)
+    {
+        if (data == nullptr || std::memcmp(data, EmptyLight()->data(), LIGHT_DATA_SIZE) == 0)
+        {
+            light = EmptyLight();
+        }
+        else if (std::memcmp(data, FullLight()->data(), LIGHT_DATA_SIZE) == 0)
+        {
+            light = FullLight();
+        }
+        else
+        {
+            if (light.use_count() > 1)
+            {
+                light = std::make_shared<LightData>();
+            }
+            std::memcpy(light->data(), data, LIGHT_DATA_SIZE);
+        }
+    }
+
+    void Section::SetLight(std::shared_ptr<LightData>& light, const int index, const unsigned char v)
+    {
+        const int shift = (index & 1) << 2;
+        unsigned char& two_values = (*light)[index >> 1];
+        const unsigned char new_two_values = (two_values & ~(0x0F << shift)) | ((v & 0x0F) << shift);
+        if (new_two_values == two_values)
+        {
+            return;
+        }
+
+        if (light.use_count() > 1)
+        {
+            light = std::make_shared<LightData>(*light);
+        }
+        (*light)[index >> 1] = new_two_values;
+    }
+
+    void Section::BuildIndex(const BlockPredicate* selector)
+    {
+        indexed_blocks.fill(0);
+        if (selector == nullptr)
+        {
+            return;
+        }
+
+        std::vector<bool> selected(palette.size(), false);
+        bool any_selected = false;
+        for (int i = 0; i < palette.size(); ++i)
+        {
+            selected[i] = !palette[i].GetProperties().air && (*selector)(palette[i]);
+            any_selected = any_selected || selected[i];
+        }
+
+        if (!any_selected)
+        {
+            return;
+        }
+
+        for (int i = 0; i < SECTION_STORAGE_SIZE; ++i)
+        {
+            if (selected[GetPaletteIndex(i)])
+            {
+                indexed_blocks[i / 64] |= 1ULL << (i % 64);
+            }
+        }
+    }
+
+    void Section::UpdateIndex(const int index, const BlockPredicate& selector)
+    {
+        const Block& block = palette[GetPaletteIndex(index)];
+        const bool selected = !block.GetProperties().air && selector(block);
+
+        if (selected)
+        {
+            indexed_blocks[index / 64] |= 1ULL << (index % 64);
+        }
+        else
+        {
+            indexed_blocks[index / 64] &= ~(1ULL << (index % 64));
+        }
+    }
+
+    void Section::FindBlocks(const BlockPredicate& predicate, const BlockPredicate* selector, std::vector<int>& out) const
+    {
+        // Check the palette first, most sections don't
+        // contain any of the blocks we're looking for
+        std::vector<bool> matching(palette.size(), false);
+        bool any_matching = false;
+        bool all_indexed = selector != nullptr;
+        for (int i = 0; i < palette.size(); ++i)
+        {
+            matching[i] = predicate(palette[i]);
+            if (matching[i])
+            {
+                any_matching = true;
+                // Air is never indexed
+                all_indexed = all_indexed && !palette[i].GetProperties().air && (*selector)(palette[i]);
+            }
+        }
+
+        if (!any_matching)
+        {
+            return;
+        }
+
+        if (all_indexed)
+        {
+            for (int i = 0; i < indexed_blocks.size(); ++i)
+            {
+                // Most words are empty, skip them at once
+                unsigned long long int word = indexed_blocks[i];
+                for (int index = i * 64; word != 0; ++index, word >>= 1)
+                {
+                    if ((word & 1) && matching[GetPaletteIndex(index)])
+                    {
+                        out.push_back(index);
+                    }
+                }
+            }
+            return;
+        }
+
+        for (int i = 0; i < SECTION_STORAGE_SIZE; ++i)
+        {
+            if (matching[GetPaletteIndex(i)])
+            {
+                out.push_back(i);
+            }
+        }
+    }
+
+    void Section::CopyRegion(const Position& min, const Position& max, const size_t stride_z, const size_t stride_y,
+        unsigned int* ids, unsigned char* block_light_out, unsigned char* sky_light_out) const
+    {
+        // Convert the palette once instead of once per block
+        std::vector<unsigned int> palette_ids(palette.size());
+        for (int i = 0; i < palette.size(); ++i)
+        {
+#if PROTOCOL_VERSION < 347
+            palette_ids[i] = Blockstate::IdMetadataToId(palette[i].GetBlockstate()->GetId(), palette[i].GetBlockstate()->GetMetadata());
+#else
+            palette_ids[i] = palette[i].GetBlockstate()->GetId();
+#endif
+        }
+
+        // Blocks are stored in y, z, x order, so all the reads are sequential
+        for (int y = min.y; y <= max.y; ++y)
+        {
+            for (int z = min.z; z <= max.z; ++z)
+            {
+                const size_t out_index = (y - min.y) * stride_y + (z - min.z) * stride_z;
+                const int index = GetBlockIndex(min.x, y, z);
+                for (int x = 0; x <= max.x - min.x; ++x)
+                {
+                    ids[out_index + x] = palette_ids[GetPaletteIndex(index + x)];
+                }
+                if (block_light_out != nullptr)
+                {
+                    for (int x = 0; x <= max.x - min.x; ++x)
+                    {
+                        block_light_out[out_index + x] = GetBlockLight(index + x);
+                    }
+                }
+                if (sky_light_out != nullptr && sky_light != nullptr)
+                {
+                    for (int x = 0; x <= max.x - min.x; ++x)
+                    {
+                        sky_light_out[out_index + x] = GetSkyLight(index + x);
+                    }
+                }
+            }
+        }
+    }
+
+    void Section::Serialize(WriteContainer& container) const
+    {
+        WriteData<unsigned char>(bits_per_entry, container);
+        WriteData<VarInt>(static_cast<int>(palette.size()), container);
+        for (int i = 0; i < palette.size(); ++i)
+        {
+            WriteData<VarInt>(palette[i].GetBlockstate()->GetId(), container);
+#if PROTOCOL_VERSION < 347
+            WriteData<unsigned char>(palette[i].GetBlockstate()->GetMetadata(), container);
+#endif
+            WriteData<VarInt>(palette[i].GetModelId(), container);
+        }
+        container.insert(container.end(), data_blocks.begin(), data_blocks.end());
+
+        SerializeLight(block_light, container);
+        SerializeLight(sky_light, container);
+    }
+
+    void Section::Deserialize(ReadIterator& iter, size_t& length)
+    {
+        const unsigned char new_bits_per_entry = ReadData<unsigned char>(iter, length);
+        if (new_bits_per_entry != 4 && new_bits_per_entry != 8 && new_bits_per_entry != 16)
+        {
+            throw(std::runtime_error("Wrong number of bits per entry in serialized section"));
+        }
+
+        const int palette_size = ReadData<VarInt>(iter, length);
+        if (palette_size < 1 || palette_size > (1 << new_bits_per_entry))
+        {
+            throw(std::runtime_error("Wrong palette size in serialized section"));
+        }
+
+        std::vector<Block> new_palette;
+        new_palette.reserve(palette_size);
+        for (int i = 0; i < palette_size; ++i)
+        {
+            const int id = ReadData<VarInt>(iter, length);
+#if PROTOCOL_VERSION < 347
+            const unsigned char metadata = ReadData<unsigned char>(iter, length);
+            const int model_id = ReadData<VarInt>(iter, length);
+            new_palette.push_back(Block(id, metadata, model_id));
+            if (new_palette.back().GetModelId() >= new_palette.back().GetBlockstate()->GetNumModels())
+            {
+                new_palette.back() = Block(id, metadata);
+            }
+#else
+            const int model_id = ReadData<VarInt>(iter, length);
+            new_palette.push_back(Block(id, model_id));
+            if (new_palette.back().GetModelId() >= new_palette.back().GetBlockstate()->GetNumModels())
+            {
+                new_palette.back() = Block(id);
+            }
+#endif
+        }
+
+        const size_t data_size = SECTION_STORAGE_SIZE * new_bits_per_entry / 8;
+        if (length < data_size)
+        {
+            throw(std::runtime_error("Not enough data in serialized section"));
+        }
+
+        bits_per_entry = new_bits_per_entry;
+        palette = std::move(new_palette);
+        data_blocks = std::vector<unsigned char>(iter, iter + data_size);
+        iter += data_size;
+        length -= data_size;
+
+        for (int i = 0; i < SECTION_STORAGE_SIZE; ++i)
+        {
+            if (GetPaletteIndex(i) >= palette.size())
+            {
+                // Don't keep a section pointing outside of its palette
+                palette = { Block() };
+                bits_per_entry = MIN_BITS_PER_ENTRY;
+                data_blocks = std::vector<unsigned char>(SECTION_STORAGE_SIZE * bits_per_entry / 8, 0);
+                throw(std::runtime_error("Palette index out of range in serialized section"));
+            }
+        }
+
+        DeserializeLight(block_light, iter, length);
+        DeserializeLight(sky_light, iter, length);
+    }
+
+    void Section::SerializeLight(const std::shared_ptr<LightData>& light, WriteContainer& container)
+    {
+        if (light == nullptr)
+        {
+            WriteData<unsigned char>(static_cast<unsigned char>(SerializedLight::None), container);
+        }
+        else if (light == EmptyLight())
+        {
+            WriteData<unsigned char>(static_cast<unsigned char>(SerializedLight::Empty), container);
+        }
+        else if (light == FullLight())
+        {
+            WriteData<unsigned char>(static_cast<unsigned char>(SerializedLight::Full), container);
+        }
+        else
+        {
+            WriteData<unsigned char>(static_cast<unsigned char>(SerializedLight::Data), container);
+            container.insert(container.end(), light->begin(), light->end());
+        }
+    }
+
+    void Section::DeserializeLight(std::shared_ptr<LightData>& light, ReadIterator& iter, size_t& length)
+    {
+        switch (static_cast<SerializedLight>(ReadData<unsigned char>(iter, length)))
+        {
+        case SerializedLight::None:
+            light = nullptr;
+            break;
+        case SerializedLight::Empty:
+            light = EmptyLight();
+            break;
+        case SerializedLight::Full:
+            light = FullLight();
+            break;
+        case SerializedLight::Data:
+            if (length < LIGHT_DATA_SIZE)
+            {
+                throw(std::runtime_error("Not enough light data in serialized section"));
+            }
+            light = std::make_shared<LightData>();
+            std::memcpy(light->data(), &(*iter), LIGHT_DATA_SIZE);
+            iter += LIGHT_DATA_SIZE;
+            length -= LIGHT_DATA_SIZE;
+            break;
+        default:
+            throw(std::runtime_error("Unknown light type in serialized section"));
+        }
+    }
+
+    const unsigned short Section::GetPaletteIndex(const int index) const
+    {
+        switch (bits_per_entry)
+        {
+        case 4:
+            return (data_blocks[index >> 1] >> ((index & 1) << 2)) & 0x0F;
+        case 8:
+            return data_blocks[index];
+        case 16:
+            return data_blocks[2 * index] | (data_blocks[2 * index + 1] << 8);
+        default:
+            return 0;
+        }
+    }
+
+    void Section::SetPaletteIndex(const int index, const unsigned short palette_index)
+    {
+        switch (bits_per_entry)
+        {
+        case 4:
+        {
+            const int shift = (index & 1) << 2;
+            data_blocks[index >> 1] = (data_blocks[index >> 1] & ~(0x0F << shift)) | ((palette_index & 0x0F) << shift);
+            break;
+        }
+        case 8:
+            data_blocks[index] = palette_index & 0xFF;
+            break;
+        case 16:
+            data_blocks[2 * index] = palette_index & 0xFF;
+            data_blocks[2 * index + 1] = (palette_index >> 8) & 0xFF;
+            break;
+        default:
+            break;
+        }
+    }
+
+    const unsigned short Section::AddToPalette(const Block& block)
+    {
+        for (int i = 0; i < palette.size(); ++i)
+        {
+            if (palette[i] == block)
+            {
+                return i;
+            }
+        }
+
+        if (palette.size() == (1 << bits_per_entry))
+        {
+            // Before growing the storage, try to
+            // make room by removing unused entries
+            CompactPalette();
+
+            if (palette.size() == (1 << bits_per_entry))
+            {
+                ResizeStorage(bits_per_entry * 2);
+            }
+        }
+
+        palette.push_back(block);
+        return static_cast<unsigned short>(palette.size() - 1);
+    }
+
+    void Section::CompactPalette()
+    {
+        std::vector<bool> used(palette.size(), false);
+        for (int i = 0; i < SECTION_STORAGE_SIZE; ++i)
+        {
+            used[GetPaletteIndex(i)] = true;
+        }
+
+        std::vector<unsigned short> remap(palette.size(), 0);
+        std::vector<Block> new_palette;
+        new_palette.reserve(palette.size());
+        for (int i = 0; i < palette.size(); ++i)
+        {
+            if (used[i])
+            {
+                remap[i] = static_cast<unsigned short>(new_palette.size());
+                new_palette.push_back(palette[i]);
+            }
+        }
+
+        if (new_palette.size() == palette.size())
+        {
+            return;
+        }
+
+        for (int i = 0; i < SECTION_STORAGE_SIZE; ++i)
+        {
+            SetPaletteIndex(i, remap[GetPaletteIndex(i)]);
+        }
+        palette = std::move(new_palette);
+    }
+
+    void Section::ResizeStorage(const unsigned char new_bits_per_entry)
+    {
+        if (new_bits_per_entry > MAX_BITS_PER_ENTRY)
+        {
+            return;
+        }
+
+        std::vector<unsigned short> indices(SECTION_STORAGE_SIZE);
+        for (int i = 0; i < SECTION_STORAGE_SIZE; ++i)
+        {
+            indices[i] = GetPaletteIndex(i);
+        }
+
+        bits_per_entry = new_bits_per_entry;
+        data_blocks = std::vector<unsigned char>(SECTION_STORAGE_SIZE * bits_per_entry / 8, 0);
+
+        for (int i = 0; i < SECTION_STORAGE_SIZE; ++i)
+        {
+            SetPaletteIndex(i, indices[i]);
+        }
+    }
+} // Botcraft
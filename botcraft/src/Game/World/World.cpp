@@ -1,25 +1,125 @@
 #include "botcraft/Game/World/World.hpp"
 #include "botcraft/Game/World/Chunk.hpp"
+#include "botcraft/Game/World/ChunkCache.hpp"
+#include "botcraft/Game/World/Section.hpp"
 #include "botcraft/Game/World/Block.hpp"
 #include "botcraft/Game/Enums.hpp"
 #include "botcraft/Utilities/AsyncHandler.hpp"
 
 #include "protocolCraft/Types/NBT/NBT.hpp"
+#include "protocolCraft/Types/NBT/TagInt.hpp"
 
 #include <iostream>
 #include <fstream>
+#include <string_view>
+#include <atomic>
+#include <tuple>
+#include <map>
+#include <algorithm>
+#include <limits>
 
 namespace Botcraft
 {
-    World::World(const bool is_shared_, const bool async_handler_)
+    // Last chunks read by each thread, so consecutive reads in the
+    // same area don't need to look into terrain. Entries are indexed
+    // by the lowest bits of the chunk coordinates, so all the chunks
+    // in a 4x4 area can be cached at the same time. It's only valid
+    // if neither the world nor its terrain changed since
+    static const int THREAD_CHUNK_CACHE_WIDTH = 4;
+
+    struct ThreadChunkCacheEntry
+    {
+        bool valid = false;
+        int x = 0;
+        int z = 0;
+        const Chunk* chunk = nullptr;
+    };
+
+    struct ThreadChunkCache
+    {
+        unsigned long long int world_id = 0;
+        unsigned long long int terrain_version = 0;
+        std::array<ThreadChunkCacheEntry, THREAD_CHUNK_CACHE_WIDTH * THREAD_CHUNK_CACHE_WIDTH> entries;
+    };
+    thread_local ThreadChunkCache thread_chunk_cache;
+
+    std::atomic<unsigned long long int> world_id_counter(0);
+
+    // Hash of all the data used to load a chunk from a packet
+    size_t ChunkDataHash(const ProtocolCraft::ClientboundLevelChunkPacket& msg)
+    {
+        const ProtocolCraft::ByteSlice& buffer = msg.GetBuffer();
+        size_t hash = std::hash<std::string_view>()(std::string_view(reinterpret_cast<const char*>(buffer.data()), buffer.size()));
+
+        // Same as boost::hash_combine
+        const auto combine = [&hash](const size_t v)
+        {
+            hash ^= v + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+        };
+
+#if PROTOCOL_VERSION < 755
+        combine(std::hash<int>()(msg.GetAvailableSections()));
+#else
+        for (int i = 0; i < msg.GetAvailableSections().size(); ++i)
+        {
+            combine(std::hash<unsigned long long int>()(msg.GetAvailableSections()[i]));
+        }
+#endif
+#if PROTOCOL_VERSION > 551
+        for (int i = 0; i < msg.GetBiomes().size(); ++i)
+        {
+            combine(std::hash<int>()(msg.GetBiomes()[i]));
+        }
+#endif
+        if (msg.GetBlockEntitiesTags().size() > 0)
+        {
+            std::vector<unsigned char> block_entities;
+            for (int i = 0; i < msg.GetBlockEntitiesTags().size(); ++i)
+            {
+                msg.GetBlockEntitiesTags()[i].Write(block_entities);
+            }
+            combine(std::hash<std::string_view>()(std::string_view(reinterpret_cast<const char*>(block_entities.data()), block_entities.size())));
+        }
+
+        // 0 is used for unknown hash
+        return hash == 0 ? 1 : hash;
+    }
+
+    // Blockstate id as sent by the server
+    const unsigned int BlockStateId(const Block* block)
+    {
+        if (block == nullptr)
+        {
+            return 0;
+        }
+#if PROTOCOL_VERSION < 347
+        return Blockstate::IdMetadataToId(block->GetBlockstate()->GetId(), block->GetBlockstate()->GetMetadata());
+#else
+        return block->GetBlockstate()->GetId();
+#endif
+    }
+
+    World::World(const bool is_shared_, const bool async_handler_) : world_id(++world_id_counter)
     {
         is_shared = is_shared_;
+        terrain_version = 0;
+        block_index_selector_version = 0;
+        memory_budget = 0;
+        memory_usage = 0;
+        peak_memory_usage = 0;
+        has_view_center = false;
+        view_center_x = 0;
+        view_center_z = 0;
+        // Default server view distance, and the one BaseClient asks for
+        view_distance = 10;
 
 #if PROTOCOL_VERSION < 719
         current_dimension = Dimension::None;
 #else
         current_dimension = "";
 #endif
+        current_min_y = CHUNK_MIN_Y;
+        current_height = CHUNK_HEIGHT;
         if (async_handler_)
         {
             async_handler = std::unique_ptr<AsyncHandler>(new AsyncHandler(this));
@@ -32,10 +132,16 @@ namespace Botcraft
 
     World::~World()
     {
-
+        if (chunk_cache)
+        {
+            for (auto it = terrain.begin(); it != terrain.end(); ++it)
+            {
+                chunk_cache->Save(it->second->GetDimension(), it->first.first, it->first.second, *it->second);
+            }
+        }
     }
 
-    std::mutex& World::GetMutex()
+    std::shared_mutex& World::GetMutex()
     {
         return world_mutex;
     }
@@ -67,12 +173,17 @@ namespace Botcraft
 
         if (!chunk)
         {
-            terrain[{x, z}] = std::shared_ptr<Chunk>(new Chunk(dim));
+            terrain.Set(x, z, std::shared_ptr<Chunk>(new Chunk(current_min_y, current_height, dim)));
+            terrain_version++;
+            UpdateChunkMemoryUsage(x, z);
         }
-        else if (chunk->GetDimension() != dim)
+        else if (chunk->GetDimension() != dim ||
+            chunk->GetMinY() != current_min_y || chunk->GetHeight() != current_height)
         {
             RemoveChunk(x, z);
-            terrain[{x, z}] = std::shared_ptr<Chunk>(new Chunk(dim));
+            terrain.Set(x, z, std::shared_ptr<Chunk>(new Chunk(current_min_y, current_height, dim)));
+            terrain_version++;
+            UpdateChunkMemoryUsage(x, z);
         }
         
         //Not necessary, from void to air, there is no difference
@@ -83,10 +194,12 @@ namespace Botcraft
 
     bool World::RemoveChunk(const int x, const int z)
     {
-        std::map<std::pair<int, int>, std::shared_ptr<Chunk> >::iterator it = terrain.find({ x, z });
-        if (it != terrain.end())
+        const size_t chunk_memory_usage = terrain.Get(x, z) ? terrain.Get(x, z)->GetMemoryUsage() : 0;
+        if (terrain.Erase(x, z))
         {
-            terrain.erase(it);
+            terrain_version++;
+            chunk_snapshots.erase({ x, z });
+            memory_usage -= chunk_memory_usage;
 
             if (cached && cached_x == x && cached_z == z)
             {
@@ -94,6 +207,11 @@ namespace Botcraft
             }
 
             UpdateChunk(x, z);
+
+            if (!change_subscriptions.empty())
+            {
+                PublishChanges({ WorldChange{ WorldChangeType::ChunkUnloaded, Position(x, 0, z), 0, 0 } });
+            }
             return true;
         }
 
@@ -103,7 +221,7 @@ namespace Botcraft
 #if USE_GUI
     const bool World::HasChunkBeenModified(const int x, const int z)
     {
-        std::shared_ptr<Chunk> chunk = GetChunk(x, z);
+        std::shared_ptr<Chunk> chunk = GetChunk(x, z, false);
         if (chunk == nullptr)
         {
             return true;
@@ -114,7 +232,8 @@ namespace Botcraft
 
     void World::ResetChunkModificationState(const int x, const int z)
     {
-        std::shared_ptr<Chunk> chunk = GetChunk(x, z);
+        // Only the render flag is modified, no need to copy the chunk
+        std::shared_ptr<Chunk> chunk = GetChunk(x, z, false);
         if (chunk == nullptr)
         {
             return;
@@ -126,11 +245,11 @@ namespace Botcraft
 #endif
 
 #if PROTOCOL_VERSION < 552
-    bool World::LoadDataInChunk(const int x, const int z, const std::vector<unsigned char>& data, const int primary_bit_mask, const bool ground_up_continuous)
+    bool World::LoadDataInChunk(const int x, const int z, const ProtocolCraft::ByteSlice& data, const int primary_bit_mask, const bool ground_up_continuous)
 #elif PROTOCOL_VERSION < 755
-    bool World::LoadDataInChunk(const int x, const int z, const std::vector<unsigned char>& data, const int primary_bit_mask)
+    bool World::LoadDataInChunk(const int x, const int z, const ProtocolCraft::ByteSlice& data, const int primary_bit_mask)
 #else
-    bool World::LoadDataInChunk(const int x, const int z, const std::vector<unsigned char>& data, const std::vector<unsigned long long int>& primary_bit_mask)
+    bool World::LoadDataInChunk(const int x, const int z, const ProtocolCraft::ByteSlice& data, const std::vector<unsigned long long int>& primary_bit_mask)
 #endif
     {
         std::shared_ptr<Chunk> chunk = GetChunk(x, z);
@@ -141,7 +260,16 @@ namespace Botcraft
 #else
             chunk->LoadChunkData(data, primary_bit_mask);
 #endif
+            if (block_index_selector)
+            {
+                chunk->BuildBlockIndex(&block_index_selector);
+            }
             UpdateChunk(x, z);
+
+            if (!change_subscriptions.empty())
+            {
+                PublishChanges({ WorldChange{ WorldChangeType::ChunkLoaded, Position(x, 0, z), 0, 0 } });
+            }
             return true;
         }
         return false;
@@ -153,7 +281,6 @@ namespace Botcraft
         if (chunk)
         {
             chunk->LoadChunkBlockEntitiesData(block_entities);
-            UpdateChunk(x, z);
             return true;
         }
         return false;
@@ -166,7 +293,6 @@ namespace Botcraft
         if (chunk)
         {
             chunk->SetBiomes(biomes);
-            UpdateChunk(x, z);
             return true;
         }
         return false;
@@ -179,32 +305,38 @@ namespace Botcraft
     bool World::SetBlock(const Position &pos, const unsigned int id, const int model_id)
 #endif
     {
-        int chunk_x = (int)floor(pos.x / (double)CHUNK_WIDTH);
-        int chunk_z = (int)floor(pos.z / (double)CHUNK_WIDTH);
+        int chunk_x = ToChunkCoord(pos.x);
+        int chunk_z = ToChunkCoord(pos.z);
 
-        if (!cached || cached_x != chunk_x || cached_z != chunk_z)
+        std::shared_ptr<Chunk> chunk = GetChunk(chunk_x, chunk_z);
+        if (!chunk)
         {
-            auto it = terrain.find({ chunk_x, chunk_z });
-
-            if (it != terrain.end())
-            {
-                cached_x = chunk_x;
-                cached_z = chunk_z;
-                cached = it->second;
-            }
-            else
-            {
-                return false;
-            }
+            return false;
         }
 
-        const int in_chunk_x = (pos.x % CHUNK_WIDTH + CHUNK_WIDTH) % CHUNK_WIDTH;
-        const int in_chunk_z = (pos.z % CHUNK_WIDTH + CHUNK_WIDTH) % CHUNK_WIDTH;
+        const int in_chunk_x = ToChunkLocalCoord(pos.x);
+        const int in_chunk_z = ToChunkLocalCoord(pos.z);
+        const unsigned int old_state = change_subscriptions.empty() ? 0 : BlockStateId(chunk->GetBlock(Position(in_chunk_x, pos.y, in_chunk_z)));
+        const int section_y = ToSectionCoord(pos.y - chunk->GetMinY());
+        const size_t old_section_usage = chunk->GetSectionMemoryUsage(section_y);
 #if PROTOCOL_VERSION < 347
-        cached->SetBlock(Position(in_chunk_x, pos.y, in_chunk_z), id, metadata, model_id);
+        chunk->SetBlock(Position(in_chunk_x, pos.y, in_chunk_z), id, metadata, model_id);
+        const unsigned int new_state = Blockstate::IdMetadataToId(id, metadata);
 #else
-        cached->SetBlock(Position(in_chunk_x, pos.y, in_chunk_z), id, model_id);
+        chunk->SetBlock(Position(in_chunk_x, pos.y, in_chunk_z), id, model_id);
+        const unsigned int new_state = id;
 #endif
+        chunk->SetDataHash(0);
+        if (block_index_selector)
+        {
+            chunk->UpdateBlockIndex(Position(in_chunk_x, pos.y, in_chunk_z), block_index_selector);
+        }
+        UpdateSectionMemoryUsage(*chunk, section_y, old_section_usage);
+
+        if (!change_subscriptions.empty() && old_state != new_state)
+        {
+            PublishChanges({ WorldChange{ WorldChangeType::BlockChanged, pos, old_state, new_state } });
+        }
 
         if (in_chunk_x > 0 && in_chunk_x < CHUNK_WIDTH - 1 &&
             in_chunk_z > 0 && in_chunk_z < CHUNK_WIDTH - 1)
@@ -236,46 +368,221 @@ namespace Botcraft
         return true;
     }
 
-    bool World::SetBlockEntityData(const Position &pos, const ProtocolCraft::NBT& data)
+    bool World::ApplySectionUpdates(const int chunk_x, const int section_y, const int chunk_z,
+        const std::vector<short>& positions, const std::vector<int>& states)
     {
-        int chunk_x = (int)floor(pos.x / (double)CHUNK_WIDTH);
-        int chunk_z = (int)floor(pos.z / (double)CHUNK_WIDTH);
+        if (positions.size() != states.size())
+        {
+            return false;
+        }
+
+        // Get the blockstates before locking the world
+        std::vector<Block> blocks;
+        blocks.reserve(states.size());
+        // Neighbour chunks that need to be updated, in the same
+        // order as in UpdateChunk (-x, +x, -z, +z)
+        bool borders[4] = { false, false, false, false };
+        for (int i = 0; i < states.size(); ++i)
+        {
+#if PROTOCOL_VERSION < 347
+            unsigned int id;
+            unsigned char metadata;
+            Blockstate::IdToIdMetadata(states[i], id, metadata);
+            blocks.push_back(Block(id, metadata));
+#else
+            blocks.push_back(Block(states[i]));
+#endif
+            const int x = (positions[i] >> 8) & 0x0F;
+            const int z = (positions[i] >> 4) & 0x0F;
+            borders[0] |= x == 0;
+            borders[1] |= x == CHUNK_WIDTH - 1;
+            borders[2] |= z == 0;
+            borders[3] |= z == CHUNK_WIDTH - 1;
+        }
 
-        if (!cached || cached_x != chunk_x || cached_z != chunk_z)
+        std::lock_guard<std::shared_mutex> world_guard(world_mutex);
+        std::shared_ptr<Chunk> chunk = GetChunk(chunk_x, chunk_z);
+        if (!chunk)
         {
-            auto it = terrain.find({ chunk_x, chunk_z });
+            return false;
+        }
 
-            if (it != terrain.end())
+        std::vector<WorldChange> changes;
+        if (!change_subscriptions.empty())
+        {
+            changes.reserve(positions.size());
+            for (int i = 0; i < positions.size(); ++i)
             {
-                cached_x = chunk_x;
-                cached_z = chunk_z;
-                cached = it->second;
+                const Position local_pos((positions[i] >> 8) & 0x0F, section_y * SECTION_HEIGHT + (positions[i] & 0x0F), (positions[i] >> 4) & 0x0F);
+                changes.push_back(WorldChange{ WorldChangeType::BlockChanged,
+                    Position(ChunkToBlockCoord(chunk_x) + local_pos.x, local_pos.y, ChunkToBlockCoord(chunk_z) + local_pos.z),
+                    BlockStateId(chunk->GetBlock(local_pos)), BlockStateId(&blocks[i]) });
             }
-            else
+        }
+
+        const int chunk_section_y = section_y - ToSectionCoord(chunk->GetMinY());
+        const size_t old_section_usage = chunk->GetSectionMemoryUsage(chunk_section_y);
+        chunk->SetSectionBlocks(chunk_section_y, positions, blocks);
+        chunk->SetDataHash(0);
+        if (block_index_selector)
+        {
+            for (int i = 0; i < positions.size(); ++i)
             {
-                return false;
+                chunk->UpdateBlockIndex(Position((positions[i] >> 8) & 0x0F, section_y * SECTION_HEIGHT + (positions[i] & 0x0F), (positions[i] >> 4) & 0x0F), block_index_selector);
             }
         }
+        UpdateSectionMemoryUsage(*chunk, chunk_section_y, old_section_usage);
 
-        if (data.HasData())
+        if (!changes.empty())
         {
-            cached->GetBlockEntitiesData()[pos] = std::shared_ptr<ProtocolCraft::NBT>(new ProtocolCraft::NBT(data));
+            // Only keep actual changes, the server can send
+            // the same state multiple times
+            changes.erase(std::remove_if(changes.begin(), changes.end(), [](const WorldChange& c) { return c.old_state == c.new_state; }), changes.end());
+            PublishChanges(changes);
         }
-        else
+
+        if ((borders[0] && borders[1]) || (borders[2] && borders[3]))
+        {
+            UpdateChunk(chunk_x, chunk_z);
+        }
+        else if (borders[0] || borders[1] || borders[2] || borders[3])
+        {
+            UpdateChunk(chunk_x, chunk_z, Position(borders[0] ? -1 : (borders[1] ? 1 : 0), 0, borders[2] ? -1 : (borders[3] ? 1 : 0)));
+        }
+
+        return true;
+    }
+
+    void World::SetIndexedBlocks(const BlockPredicate& selector)
+    {
+        std::lock_guard<std::shared_mutex> world_guard(world_mutex);
+        block_index_selector = selector;
+        block_index_selector_version++;
+
+        std::vector<std::pair<int, int> > coords;
+        coords.reserve(terrain.size());
+        for (auto it = terrain.begin(); it != terrain.end(); ++it)
+        {
+            coords.push_back(it->first);
+        }
+
+        // GetChunk can modify terrain if a chunk must be copied
+        for (int i = 0; i < coords.size(); ++i)
+        {
+            std::shared_ptr<Chunk> chunk = GetChunk(coords[i].first, coords[i].second);
+            chunk->BuildBlockIndex(block_index_selector ? &block_index_selector : nullptr);
+        }
+    }
+
+    const bool World::FindNearest(const Position& pos, const BlockPredicate& predicate, const int radius, Position& out_pos) const
+    {
+        if (radius < 0)
+        {
+            return false;
+        }
+
+        // Distance between v and the [min, max] range
+        const auto axis_distance = [](const int v, const int min, const int max)
+        {
+            return v < min ? min - v : (v > max ? v - max : 0);
+        };
+
+        struct SectionCandidate
+        {
+            const Chunk* chunk;
+            int chunk_x;
+            int chunk_z;
+            int section_y;
+            // Squared distance between pos and the closest block of the section
+            int min_distance;
+        };
+
+        const int max_distance = radius * radius;
+        std::vector<SectionCandidate> candidates;
+        for (int chunk_x = ToChunkCoord(pos.x - radius); chunk_x <= ToChunkCoord(pos.x + radius); ++chunk_x)
+        {
+            const int dx = axis_distance(pos.x, ChunkToBlockCoord(chunk_x), ChunkToBlockCoord(chunk_x) + CHUNK_WIDTH - 1);
+            for (int chunk_z = ToChunkCoord(pos.z - radius); chunk_z <= ToChunkCoord(pos.z + radius); ++chunk_z)
+            {
+                const Chunk* chunk = GetChunkForReading(chunk_x, chunk_z);
+                if (chunk == nullptr)
+                {
+                    continue;
+                }
+
+                const int dz = axis_distance(pos.z, ChunkToBlockCoord(chunk_z), ChunkToBlockCoord(chunk_z) + CHUNK_WIDTH - 1);
+                const int min_section = std::max(0, ToSectionCoord(pos.y - radius - chunk->GetMinY()));
+                const int max_section = std::min(chunk->GetHeight() / SECTION_HEIGHT - 1, ToSectionCoord(pos.y + radius - chunk->GetMinY()));
+                for (int y = min_section; y <= max_section; ++y)
+                {
+                    if (!chunk->HasSection(y))
+                    {
+                        continue;
+                    }
+
+                    const int section_min_y = chunk->GetMinY() + y * SECTION_HEIGHT;
+                    const int dy = axis_distance(pos.y, section_min_y, section_min_y + SECTION_HEIGHT - 1);
+                    const int min_distance = dx * dx + dy * dy + dz * dz;
+                    if (min_distance <= max_distance)
+                    {
+                        candidates.push_back(SectionCandidate{ chunk, chunk_x, chunk_z, y, min_distance });
+                    }
+                }
+            }
+        }
+
+        // Search the closest sections first, and stop as soon
+        // as no remaining section can contain a closer block
+        std::sort(candidates.begin(), candidates.end(), [](const SectionCandidate& a, const SectionCandidate& b) { return a.min_distance < b.min_distance; });
+
+        const BlockPredicate* selector = block_index_selector ? &block_index_selector : nullptr;
+        int best_distance = max_distance + 1;
+        std::vector<Position> found;
+        for (int i = 0; i < candidates.size() && candidates[i].min_distance < best_distance; ++i)
+        {
+            found.clear();
+            candidates[i].chunk->FindBlocks(candidates[i].section_y, predicate, selector, found);
+            for (int j = 0; j < found.size(); ++j)
+            {
+                const Position block_pos(ChunkToBlockCoord(candidates[i].chunk_x) + found[j].x, found[j].y, ChunkToBlockCoord(candidates[i].chunk_z) + found[j].z);
+                const Position diff = block_pos - pos;
+                const int distance = diff.x * diff.x + diff.y * diff.y + diff.z * diff.z;
+                if (distance < best_distance)
+                {
+                    best_distance = distance;
+                    out_pos = block_pos;
+                }
+            }
+        }
+
+        return best_distance <= max_distance;
+    }
+
+    bool World::SetBlockEntityData(const Position &pos, const ProtocolCraft::NBT& data)
+    {
+        int chunk_x = ToChunkCoord(pos.x);
+        int chunk_z = ToChunkCoord(pos.z);
+
+        std::shared_ptr<Chunk> chunk = GetChunk(chunk_x, chunk_z);
+        if (!chunk)
         {
-            cached->GetBlockEntitiesData().erase(pos);
+            return false;
         }
+
+        chunk->SetBlockEntityData(ToChunkLocalPosition(pos), data);
+        chunk->SetDataHash(0);
         return true;
     }
 
 #if PROTOCOL_VERSION < 358
     bool World::SetBiome(const int x, const int z, const unsigned char biome)
 	{
-		auto it = terrain.find({ floor(x / (double)CHUNK_WIDTH), floor(z / (double)CHUNK_WIDTH) });
+		std::shared_ptr<Chunk> chunk = GetChunk(ToChunkCoord(x), ToChunkCoord(z));
 
-		if (it != terrain.end())
+		if (chunk)
 		{
-			it->second->SetBiome((x % CHUNK_WIDTH + CHUNK_WIDTH) % CHUNK_WIDTH, (z % CHUNK_WIDTH + CHUNK_WIDTH) % CHUNK_WIDTH, biome);
+			chunk->SetBiome(ToChunkLocalCoord(x), ToChunkLocalCoord(z), biome);
+			chunk->SetDataHash(0);
 			return true;
 		}
 
@@ -284,11 +591,12 @@ namespace Botcraft
 #elif PROTOCOL_VERSION < 552
 	bool World::SetBiome(const int x, const int z, const int biome)
 	{
-		auto it = terrain.find({ floor(x / (double)CHUNK_WIDTH), floor(z / (double)CHUNK_WIDTH) });
+		std::shared_ptr<Chunk> chunk = GetChunk(ToChunkCoord(x), ToChunkCoord(z));
 
-		if (it != terrain.end())
+		if (chunk)
 		{
-			it->second->SetBiome((x % CHUNK_WIDTH + CHUNK_WIDTH) % CHUNK_WIDTH, (z % CHUNK_WIDTH + CHUNK_WIDTH) % CHUNK_WIDTH, biome);
+			chunk->SetBiome(ToChunkLocalCoord(x), ToChunkLocalCoord(z), biome);
+			chunk->SetDataHash(0);
 			return true;
 		}
 
@@ -297,11 +605,12 @@ namespace Botcraft
 #else
 	bool World::SetBiome(const int x, const int y, const int z, const int biome)
     {
-        auto it = terrain.find({ floor(x / (double)CHUNK_WIDTH), floor(z / (double)CHUNK_WIDTH) });
+        std::shared_ptr<Chunk> chunk = GetChunk(ToChunkCoord(x), ToChunkCoord(z));
 
-        if (it != terrain.end())
+        if (chunk)
         {
-            it->second->SetBiome((x % CHUNK_WIDTH + CHUNK_WIDTH) % CHUNK_WIDTH, y, (z % CHUNK_WIDTH + CHUNK_WIDTH) % CHUNK_WIDTH, biome);
+            chunk->SetBiome(ToChunkLocalCoord(x), y, ToChunkLocalCoord(z), biome);
+            chunk->SetDataHash(0);
             return true;
         }
 
@@ -311,16 +620,16 @@ namespace Botcraft
 
     bool World::SetSkyLight(const Position &pos, const unsigned char skylight)
     {
-        auto it = terrain.find({ floor(pos.x / (double)CHUNK_WIDTH), floor(pos.z / (double)CHUNK_WIDTH) });
+        std::shared_ptr<Chunk> chunk = GetChunk(ToChunkCoord(pos.x), ToChunkCoord(pos.z));
 
-        if (it != terrain.end() &&
+        if (chunk &&
 #if PROTOCOL_VERSION < 719
-            it->second->GetDimension() == Dimension::Overworld)
+            chunk->GetDimension() == Dimension::Overworld)
 #else
-            it->second->GetDimension() == "minecraft:overworld")
+            chunk->GetDimension() == "minecraft:overworld")
 #endif
         {
-            it->second->SetSkyLight(Position((pos.x % CHUNK_WIDTH + CHUNK_WIDTH) % CHUNK_WIDTH, pos.y, (pos.z % CHUNK_WIDTH + CHUNK_WIDTH) % CHUNK_WIDTH), skylight);
+            chunk->SetSkyLight(ToChunkLocalPosition(pos), skylight);
             return true;
         }
 
@@ -329,11 +638,11 @@ namespace Botcraft
 
     bool World::SetBlockLight(const Position &pos, const unsigned char blocklight)
     {
-        auto it = terrain.find({ floor(pos.x / (double)CHUNK_WIDTH), floor(pos.z / (double)CHUNK_WIDTH) });
+        std::shared_ptr<Chunk> chunk = GetChunk(ToChunkCoord(pos.x), ToChunkCoord(pos.z));
 
-        if (it != terrain.end())
+        if (chunk)
         {
-            it->second->SetBlockLight(Position((pos.x % CHUNK_WIDTH + CHUNK_WIDTH) % CHUNK_WIDTH, pos.y, (pos.z % CHUNK_WIDTH + CHUNK_WIDTH) % CHUNK_WIDTH), blocklight);
+            chunk->SetBlockLight(ToChunkLocalPosition(pos), blocklight);
             return true;
         }
 
@@ -362,49 +671,35 @@ namespace Botcraft
         }
 
         int counter_arrays = 0;
-        Position pos1, pos2;
 
-        const int num_sections = CHUNK_HEIGHT / 16 + 2;
+        // Light data has one more section below and above the chunk
+        const int num_sections = chunk->GetHeight() / SECTION_HEIGHT + 2;
 
         for (int i = 0; i < num_sections; ++i)
         {
             const int section_Y = i - 1;
 
-            // Sky light
 #if PROTOCOL_VERSION < 755
             if ((light_mask >> i) & 1)
 #else
             if ((light_mask.size() > i / 64) && (light_mask[i / 64] >> (i % 64)) & 1)
 #endif
             {
+                if (counter_arrays >= data.size())
+                {
+                    std::cerr << "Warning, missing light data for chunk " << x << ", " << z << std::endl;
+                    return;
+                }
+
                 if (i > 0 && i < num_sections - 1)
                 {
-                    for (int block_y = 0; block_y < SECTION_HEIGHT; ++block_y)
+                    if (data[counter_arrays].size() == LIGHT_DATA_SIZE)
+                    {
+                        chunk->LoadSectionLight(section_Y, reinterpret_cast<const unsigned char*>(data[counter_arrays].data()), sky);
+                    }
+                    else
                     {
-                        pos1.y = block_y + section_Y * SECTION_HEIGHT;
-                        pos2.y = pos1.y;
-                        for (int block_z = 0; block_z < CHUNK_WIDTH; ++block_z)
-                        {
-                            pos1.z = block_z;
-                            pos2.z = block_z;
-                            for (int block_x = 0; block_x < CHUNK_WIDTH; block_x += 2)
-                            {
-                                pos1.x = block_x;
-                                pos2.x = block_x + 1;
-                                const char two_light_values = data[counter_arrays][(block_y * CHUNK_WIDTH * CHUNK_WIDTH + block_z * CHUNK_WIDTH + block_x) / 2];
-
-                                if (sky)
-                                {
-                                    chunk->SetSkyLight(pos1, two_light_values & 0x0F);
-                                    chunk->SetSkyLight(pos2, (two_light_values >> 4) & 0x0F);
-                                }
-                                else
-                                {
-                                    chunk->SetBlockLight(pos1, two_light_values & 0x0F);
-                                    chunk->SetBlockLight(pos2, (two_light_values >> 4) & 0x0F);
-                                }
-                            }
-                        }
+                        std::cerr << "Warning, wrong light data size for chunk " << x << ", " << z << std::endl;
                     }
                 }
                 counter_arrays++;
@@ -417,320 +712,583 @@ namespace Botcraft
             {
                 if (i > 0 && i < num_sections - 1)
                 {
-                    for (int block_y = 0; block_y < SECTION_HEIGHT; ++block_y)
-                    {
-                        pos1.y = block_y + section_Y * SECTION_HEIGHT;
-                        pos2.y = pos1.y;
-                        for (int block_z = 0; block_z < CHUNK_WIDTH; ++block_z)
-                        {
-                            pos1.z = block_z;
-                            pos2.z = block_z;
-                            for (int block_x = 0; block_x < CHUNK_WIDTH; block_x += 2)
-                            {
-                                pos1.x = block_x;
-                                pos2.x = block_x + 1;
-                                if (sky)
-                                {
-                                    chunk->SetSkyLight(pos1, 0);
-                                    chunk->SetSkyLight(pos2, 0);
-                                }
-                                else
-                                {
-                                    chunk->SetBlockLight(pos1, 0);
-                                    chunk->SetBlockLight(pos2, 0);
-                                }
-                            }
-                        }
-                    }
+                    chunk->LoadSectionLight(section_Y, nullptr, sky);
                 }
             }
         }
+
+        UpdateChunkMemoryUsage(x, z);
     }
 
 #endif
 
     void World::UpdateChunk(const int x, const int z, const Position& pos)
     {
-        std::shared_ptr<Chunk> chunk = GetChunk(x, z);
-        if (pos == Position())
+#if USE_GUI
+        // Chunks don't store their neighbours' blocks anymore, the
+        // only thing to do is to tell the renderer that the faces
+        // on the border of the neighbour chunks may have changed
+        const bool all_neighbours = pos == Position();
+        const int neighbours[4][2] = { { -1, 0 }, { 1, 0 }, { 0, -1 }, { 0, 1 } };
+        for (int i = 0; i < 4; ++i)
         {
-            if (chunk)
+            if (!all_neighbours &&
+                (neighbours[i][0] == 0 || neighbours[i][0] != pos.x) &&
+                (neighbours[i][1] == 0 || neighbours[i][1] != pos.z))
             {
-                chunk->UpdateNeighbour(GetChunk(x - 1, z), Orientation::West);
-                chunk->UpdateNeighbour(GetChunk(x + 1, z), Orientation::East);
-                chunk->UpdateNeighbour(GetChunk(x, z - 1), Orientation::North);
-                chunk->UpdateNeighbour(GetChunk(x, z + 1), Orientation::South);
+                continue;
             }
-            else
+
+            // Only the render flag is modified, no need to copy the chunk
+            std::shared_ptr<Chunk> neighbour_chunk = GetChunk(x + neighbours[i][0], z + neighbours[i][1], false);
+            if (neighbour_chunk)
             {
-                std::shared_ptr<Chunk> neighbour_chunk;
-                neighbour_chunk = GetChunk(x - 1, z);
-                if (neighbour_chunk)
-                {
-                    neighbour_chunk->UpdateNeighbour(nullptr, Orientation::East);
-                }
-                neighbour_chunk = GetChunk(x + 1, z);
-                if (neighbour_chunk)
-                {
-                    neighbour_chunk->UpdateNeighbour(nullptr, Orientation::West);
-                }
-                neighbour_chunk = GetChunk(x, z - 1);
-                if (neighbour_chunk)
-                {
-                    neighbour_chunk->UpdateNeighbour(nullptr, Orientation::South);
-                }
-                neighbour_chunk = GetChunk(x, z + 1);
-                if (neighbour_chunk)
-                {
-                    neighbour_chunk->UpdateNeighbour(nullptr, Orientation::North);
-                }
+                neighbour_chunk->SetModifiedSinceLastRender(true);
             }
-            return;
         }
-        
-        if (pos.x == -1)
+#endif
+    }
+
+    void World::SetChunkCache(const std::shared_ptr<ChunkCache>& cache)
+    {
+        std::lock_guard<std::shared_mutex> world_guard(world_mutex);
+        chunk_cache = cache;
+    }
+
+    void World::SaveChunksToCache()
+    {
+        std::shared_ptr<ChunkCache> cache;
+        std::vector<std::tuple<int, int, std::shared_ptr<const Chunk> > > chunks;
         {
-            std::shared_ptr<Chunk> neighbour_chunk = GetChunk(x - 1, z);
-            if (chunk)
+            std::lock_guard<std::shared_mutex> world_guard(world_mutex);
+            if (chunk_cache == nullptr)
             {
-                chunk->UpdateNeighbour(neighbour_chunk, Orientation::West);
+                return;
             }
-            else if (neighbour_chunk)
+            cache = chunk_cache;
+            chunks.reserve(terrain.size());
+            for (auto it = terrain.begin(); it != terrain.end(); ++it)
             {
-                neighbour_chunk->UpdateNeighbour(nullptr, Orientation::East);
+                chunks.push_back({ it->first.first, it->first.second, GetChunkCopy(it->first.first, it->first.second) });
             }
         }
-        else if (pos.x == 1)
+
+        // Snapshots can be saved without locking the world
+        for (int i = 0; i < chunks.size(); ++i)
         {
-            std::shared_ptr<Chunk> neighbour_chunk = GetChunk(x + 1, z);
-            if (chunk)
-            {
-                chunk->UpdateNeighbour(neighbour_chunk, Orientation::East);
-            }
-            else if (neighbour_chunk)
-            {
-                neighbour_chunk->UpdateNeighbour(nullptr, Orientation::West);
-            }
+            const std::shared_ptr<const Chunk>& chunk = std::get<2>(chunks[i]);
+            cache->Save(chunk->GetDimension(), std::get<0>(chunks[i]), std::get<1>(chunks[i]), *chunk);
         }
+    }
 
-        if (pos.z == -1)
+    const std::shared_ptr<const Chunk> World::GetChunkFromCache(const int x, const int z) const
+    {
+        std::shared_ptr<ChunkCache> cache;
+#if PROTOCOL_VERSION < 719
+        Dimension dim;
+#else
+        std::string dim;
+#endif
         {
-            std::shared_ptr<Chunk> neighbour_chunk = GetChunk(x, z - 1);
-            if (chunk)
+            std::shared_lock<std::shared_mutex> world_guard(world_mutex);
+            cache = chunk_cache;
+            dim = current_dimension;
+        }
+
+        if (cache == nullptr)
+        {
+            return nullptr;
+        }
+
+        return cache->Load(dim, x, z);
+    }
+
+    std::shared_ptr<WorldChangeSubscription> World::SubscribeToChanges(const size_t capacity)
+    {
+        std::shared_ptr<WorldChangeSubscription> subscription(new WorldChangeSubscription(capacity));
+
+        std::lock_guard<std::shared_mutex> world_guard(world_mutex);
+        change_subscriptions.push_back(subscription);
+
+        return subscription;
+    }
+
+    void World::SetMemoryBudget(const size_t bytes)
+    {
+        std::shared_ptr<ChunkCache> cache;
+        std::vector<std::tuple<int, int, std::shared_ptr<Chunk> > > evicted_chunks;
+        {
+            std::lock_guard<std::shared_mutex> world_guard(world_mutex);
+            memory_budget = bytes;
+            cache = chunk_cache;
+            evicted_chunks = EvictChunks();
+        }
+
+        SaveRemovedChunks(cache, evicted_chunks);
+    }
+
+    void World::SaveRemovedChunks(const std::shared_ptr<ChunkCache>& cache, const std::vector<std::tuple<int, int, std::shared_ptr<Chunk> > >& chunks)
+    {
+        if (!cache)
+        {
+            return;
+        }
+
+        // Removed chunks are not in the world anymore,
+        // they can be saved without locking it
+        for (int i = 0; i < chunks.size(); ++i)
+        {
+            const std::shared_ptr<Chunk>& chunk = std::get<2>(chunks[i]);
+            cache->Save(chunk->GetDimension(), std::get<0>(chunks[i]), std::get<1>(chunks[i]), *chunk);
+        }
+    }
+
+    const size_t World::GetMemoryUsage() const
+    {
+        return memory_usage;
+    }
+
+    const size_t World::GetPeakMemoryUsage() const
+    {
+        return peak_memory_usage;
+    }
+
+    void World::SetViewCenter(const void* client, const int chunk_x, const int chunk_z)
+    {
+        std::lock_guard<std::shared_mutex> world_guard(world_mutex);
+        view_centers[client] = { chunk_x, chunk_z };
+    }
+
+    void World::RemoveViewCenter(const void* client)
+    {
+        std::lock_guard<std::shared_mutex> world_guard(world_mutex);
+        view_centers.erase(client);
+    }
+
+    void World::UpdateChunkMemoryUsage(const int x, const int z)
+    {
+        std::shared_ptr<Chunk> chunk = GetChunk(x, z);
+        if (!chunk)
+        {
+            return;
+        }
+
+        const size_t old_usage = chunk->GetMemoryUsage();
+        chunk->UpdateMemoryUsage();
+        memory_usage = memory_usage - old_usage + chunk->GetMemoryUsage();
+        if (memory_usage > peak_memory_usage)
+        {
+            peak_memory_usage = memory_usage.load();
+        }
+    }
+
+    void World::UpdateSectionMemoryUsage(Chunk& chunk, const int section_y, const size_t old_section_usage)
+    {
+        const size_t old_usage = chunk.GetMemoryUsage();
+        chunk.UpdateSectionMemoryUsage(section_y, old_section_usage);
+        memory_usage = memory_usage - old_usage + chunk.GetMemoryUsage();
+        if (memory_usage > peak_memory_usage)
+        {
+            peak_memory_usage = memory_usage.load();
+        }
+    }
+
+    void World::ReplaceChunk(const int x, const int z, const std::shared_ptr<Chunk>& chunk)
+    {
+#if PROTOCOL_VERSION > 404
+        // Light is sent in its own packets, before the chunk data,
+        // and isn't part of the data hash. The light already in the
+        // world is more recent than the one of the new chunk
+        const std::shared_ptr<Chunk>& live_chunk = terrain.Get(x, z);
+        if (live_chunk && live_chunk->GetDimension() == chunk->GetDimension())
+        {
+            chunk->CopyLight(*live_chunk);
+        }
+#endif
+        // The server sends the chunk the player
+        // is in first after login/respawn
+        if (!has_view_center)
+        {
+            view_center_x = x;
+            view_center_z = z;
+            has_view_center = true;
+        }
+        if (terrain.Get(x, z))
+        {
+            memory_usage -= terrain.Get(x, z)->GetMemoryUsage();
+        }
+        terrain.Set(x, z, chunk);
+        terrain_version++;
+        chunk_snapshots.erase({ x, z });
+        if (cached && cached_x == x && cached_z == z)
+        {
+            cached = nullptr;
+        }
+        UpdateChunk(x, z);
+        UpdateChunkMemoryUsage(x, z);
+
+        if (!change_subscriptions.empty())
+        {
+            PublishChanges({ WorldChange{ WorldChangeType::ChunkLoaded, Position(x, 0, z), 0, 0 } });
+        }
+    }
+
+    std::vector<std::tuple<int, int, std::shared_ptr<Chunk> > > World::EvictChunks()
+    {
+        std::vector<std::tuple<int, int, std::shared_ptr<Chunk> > > evicted_chunks;
+        if (memory_budget == 0 || memory_usage <= memory_budget)
+        {
+            return evicted_chunks;
+        }
+
+        // Go a bit under the budget so we don't
+        // have to evict again on the next chunk
+        const size_t target = memory_budget / 10 * 9;
+
+        // The server sends the chunks in view distance only once, so they
+        // are never evicted. Vanilla also keeps one more ring of chunks
+        const int protected_distance = view_distance + 1;
+        std::vector<std::pair<int, int> > centers;
+        centers.reserve(view_centers.size() + 1);
+        for (auto it = view_centers.begin(); it != view_centers.end(); ++it)
+        {
+            centers.push_back(it->second);
+        }
+        if (has_view_center)
+        {
+            centers.push_back({ view_center_x, view_center_z });
+        }
+
+        std::vector<std::pair<long long int, std::pair<int, int> > > chunks_by_distance;
+        chunks_by_distance.reserve(terrain.size());
+        for (auto it = terrain.begin(); it != terrain.end(); ++it)
+        {
+            // Distance to the closest center
+            long long int min_sqr_distance = std::numeric_limits<long long int>::max();
+            bool is_protected = false;
+            for (int i = 0; i < centers.size(); ++i)
             {
-                chunk->UpdateNeighbour(neighbour_chunk, Orientation::North);
+                const long long int dx = it->first.first - centers[i].first;
+                const long long int dz = it->first.second - centers[i].second;
+                if (std::abs(dx) <= protected_distance && std::abs(dz) <= protected_distance)
+                {
+                    is_protected = true;
+                    break;
+                }
+                min_sqr_distance = std::min(min_sqr_distance, dx * dx + dz * dz);
             }
-            else if (neighbour_chunk)
+            if (is_protected)
             {
-                neighbour_chunk->UpdateNeighbour(nullptr, Orientation::South);
+                continue;
             }
+            chunks_by_distance.push_back({ min_sqr_distance, it->first });
         }
-        else if (pos.z == 1)
+        // Farthest first
+        std::sort(chunks_by_distance.begin(), chunks_by_distance.end(),
+            [](const std::pair<long long int, std::pair<int, int> >& a, const std::pair<long long int, std::pair<int, int> >& b) { return a.first > b.first; });
+
+        for (int i = 0; i < chunks_by_distance.size() && memory_usage > target; ++i)
         {
-            std::shared_ptr<Chunk> neighbour_chunk = GetChunk(x, z + 1);
+            const int x = chunks_by_distance[i].second.first;
+            const int z = chunks_by_distance[i].second.second;
+            std::shared_ptr<Chunk> chunk = GetChunk(x, z, false);
+            RemoveChunk(x, z);
             if (chunk)
             {
-                chunk->UpdateNeighbour(neighbour_chunk, Orientation::South);
+                evicted_chunks.push_back({ x, z, chunk });
             }
-            else if (neighbour_chunk)
+        }
+
+        return evicted_chunks;
+    }
+
+    void World::PublishChanges(const std::vector<WorldChange>& changes)
+    {
+        if (changes.empty())
+        {
+            return;
+        }
+
+        for (auto it = change_subscriptions.begin(); it != change_subscriptions.end();)
+        {
+            std::shared_ptr<WorldChangeSubscription> subscription = it->lock();
+            if (subscription == nullptr)
             {
-                neighbour_chunk->UpdateNeighbour(nullptr, Orientation::North);
+                it = change_subscriptions.erase(it);
+                continue;
             }
+            subscription->Push(changes);
+            ++it;
         }
     }
 
     const std::shared_ptr<const Chunk> World::GetChunkCopy(const int x, const int z)
     {
-        std::shared_ptr<Chunk> chunk = GetChunk(x, z);
+        std::shared_ptr<Chunk> chunk = GetChunk(x, z, false);
         if (chunk == nullptr)
         {
             return nullptr;
         }
 
-        return std::shared_ptr<const Chunk>(new Chunk(*chunk));
-    }
-
-    const Block* World::GetBlock(const Position &pos)
-    {
-        int chunk_x = (int)floor(pos.x / (double)CHUNK_WIDTH);
-        int chunk_z = (int)floor(pos.z / (double)CHUNK_WIDTH);
-
-        if (!cached || cached_x != chunk_x || cached_z != chunk_z)
+        // No actual copy here, the world will copy the
+        // chunk before modifying it if it's still in use
+        auto it = chunk_snapshots.find({ x, z });
+        if (it != chunk_snapshots.end())
         {
-            auto it = terrain.find({ chunk_x, chunk_z });
-
-            if (it != terrain.end())
-            {
-                cached_x = chunk_x;
-                cached_z = chunk_z;
-                cached = it->second;
-            }
-            else
+            std::shared_ptr<const Chunk> snapshot = it->second.lock();
+            if (snapshot.get() == chunk.get())
             {
-                return nullptr;
+                return snapshot;
             }
         }
-        return cached->GetBlock(Position((pos.x % CHUNK_WIDTH + CHUNK_WIDTH) % CHUNK_WIDTH, pos.y, (pos.z % CHUNK_WIDTH + CHUNK_WIDTH) % CHUNK_WIDTH));
+
+        // The snapshot has its own ref count (the chunk
+        // is owned by the snapshot owner) so we can
+        // know when all the snapshots are gone
+        std::shared_ptr<std::shared_ptr<Chunk> > owner = std::make_shared<std::shared_ptr<Chunk> >(chunk);
+        std::shared_ptr<const Chunk> snapshot(owner, owner->get());
+        chunk_snapshots[{ x, z }] = snapshot;
+
+        return snapshot;
     }
 
-    const bool World::IsLoaded(const Position& pos) const
+    const Block* World::GetBlock(const Position &pos) const
     {
-        const int chunk_x = (int)floor(pos.x / (double)CHUNK_WIDTH);
-        const int chunk_z = (int)floor(pos.z / (double)CHUNK_WIDTH);
-
-        return terrain.find({ chunk_x, chunk_z }) != terrain.end();
+        const Chunk* chunk = GetChunkForReading(ToChunkCoord(pos.x), ToChunkCoord(pos.z));
+        if (chunk == nullptr)
+        {
+            return nullptr;
+        }
+        return chunk->GetBlock(ToChunkLocalPosition(pos));
     }
 
-    std::shared_ptr<ProtocolCraft::NBT> World::GetBlockEntityData(const Position &pos)
+    bool World::SnapshotRegion(const Position& min, const Position& max, unsigned int* ids,
+        unsigned char* block_light, unsigned char* sky_light) const
     {
-        int chunk_x = (int)floor(pos.x / (double)CHUNK_WIDTH);
-        int chunk_z = (int)floor(pos.z / (double)CHUNK_WIDTH);
+        if (min.x > max.x || min.y > max.y || min.z > max.z)
+        {
+            return false;
+        }
+
+        const size_t size_x = max.x - min.x + 1;
+        const size_t size_y = max.y - min.y + 1;
+        const size_t size_z = max.z - min.z + 1;
+        const size_t size = size_x * size_y * size_z;
 
-        if (cached && cached_x == chunk_x && cached_z == chunk_z)
+        // Unloaded chunks and empty sections are not written
+        std::fill(ids, ids + size, 0);
+        if (block_light != nullptr)
         {
-            return cached->GetBlockEntityData(Position((pos.x % CHUNK_WIDTH + CHUNK_WIDTH) % CHUNK_WIDTH, pos.y, (pos.z % CHUNK_WIDTH + CHUNK_WIDTH) % CHUNK_WIDTH));
+            std::fill(block_light, block_light + size, 0);
         }
-        else
+        if (sky_light != nullptr)
         {
-            auto it = terrain.find({ chunk_x, chunk_z });
+            std::fill(sky_light, sky_light + size, 0);
+        }
 
-            if (it != terrain.end())
+        std::shared_lock<std::shared_mutex> world_guard(world_mutex);
+        for (int chunk_x = ToChunkCoord(min.x); chunk_x <= ToChunkCoord(max.x); ++chunk_x)
+        {
+            for (int chunk_z = ToChunkCoord(min.z); chunk_z <= ToChunkCoord(max.z); ++chunk_z)
             {
-                cached_x = chunk_x;
-                cached_z = chunk_z;
-                cached = it->second;
+                const Chunk* chunk = GetChunkForReading(chunk_x, chunk_z);
+                if (chunk == nullptr)
+                {
+                    continue;
+                }
 
-                return cached->GetBlockEntityData(Position((pos.x % CHUNK_WIDTH + CHUNK_WIDTH) % CHUNK_WIDTH, pos.y, (pos.z % CHUNK_WIDTH + CHUNK_WIDTH) % CHUNK_WIDTH));
+                // Region bounds in this chunk, CopyRegion clamps them to the chunk
+                const int chunk_min_x = std::max(min.x, ChunkToBlockCoord(chunk_x));
+                const int chunk_min_z = std::max(min.z, ChunkToBlockCoord(chunk_z));
+                const size_t offset = (chunk_min_z - min.z) * size_x + (chunk_min_x - min.x);
+
+                chunk->CopyRegion(
+                    Position(chunk_min_x - ChunkToBlockCoord(chunk_x), min.y, chunk_min_z - ChunkToBlockCoord(chunk_z)),
+                    Position(max.x - ChunkToBlockCoord(chunk_x), max.y, max.z - ChunkToBlockCoord(chunk_z)),
+                    size_x, size_x * size_z, ids + offset,
+                    block_light == nullptr ? nullptr : block_light + offset,
+                    sky_light == nullptr ? nullptr : sky_light + offset);
             }
         }
 
-        return nullptr;
+        return true;
+    }
+
+    const int World::GetHighestBlock(const Heightmap type, const int x, const int z) const
+    {
+        const Chunk* chunk = GetChunkForReading(ToChunkCoord(x), ToChunkCoord(z));
+        if (chunk == nullptr)
+        {
+            return current_min_y - 1;
+        }
+        return chunk->GetHighestBlock(type, ToChunkLocalCoord(x), ToChunkLocalCoord(z));
+    }
+
+    const int World::GetHighestSolid(const int x, const int z) const
+    {
+        return GetHighestBlock(Heightmap::Solid, x, z);
+    }
+
+    const bool World::IsLoaded(const Position& pos) const
+    {
+        return GetChunkForReading(ToChunkCoord(pos.x), ToChunkCoord(pos.z)) != nullptr;
+    }
+
+    std::shared_ptr<const ProtocolCraft::NBT> World::GetBlockEntityData(const Position &pos) const
+    {
+        const Chunk* chunk = GetChunkForReading(ToChunkCoord(pos.x), ToChunkCoord(pos.z));
+        if (chunk == nullptr)
+        {
+            return nullptr;
+        }
+        return chunk->GetBlockEntityData(ToChunkLocalPosition(pos));
     }
 
 #if PROTOCOL_VERSION < 358
-    const unsigned char World::GetBiome(const Position &pos)
+    const unsigned char World::GetBiome(const Position &pos) const
 #else
-    const int World::GetBiome(const Position &pos)
+    const int World::GetBiome(const Position &pos) const
 #endif
     {
-        int chunk_x = (int)floor(pos.x / (double)CHUNK_WIDTH);
-        int chunk_z = (int)floor(pos.z / (double)CHUNK_WIDTH);
-
-        if (!cached || cached_x != chunk_x || cached_z != chunk_z)
+        const Chunk* chunk = GetChunkForReading(ToChunkCoord(pos.x), ToChunkCoord(pos.z));
+        if (chunk == nullptr)
         {
-            auto it = terrain.find({ chunk_x, chunk_z });
-
-            if (it != terrain.end())
-            {
-                cached_x = chunk_x;
-                cached_z = chunk_z;
-                cached = it->second;
-            }
-            else
-            {
-                return 0;
-            }
+            return 0;
         }
 #if PROTOCOL_VERSION < 552
-		return cached->GetBiome((pos.x % CHUNK_WIDTH + CHUNK_WIDTH) % CHUNK_WIDTH, (pos.z % CHUNK_WIDTH + CHUNK_WIDTH) % CHUNK_WIDTH);
+		return chunk->GetBiome(ToChunkLocalCoord(pos.x), ToChunkLocalCoord(pos.z));
 #else
-        return cached->GetBiome((pos.x % CHUNK_WIDTH + CHUNK_WIDTH) % CHUNK_WIDTH, pos.y, (pos.z % CHUNK_WIDTH + CHUNK_WIDTH) % CHUNK_WIDTH);
+        return chunk->GetBiome(ToChunkLocalCoord(pos.x), pos.y, ToChunkLocalCoord(pos.z));
 #endif
 	}
 
-    const unsigned char World::GetSkyLight(const Position &pos)
+    const Biome* World::GetBiomePtr(const Position& pos) const
     {
-        int chunk_x = (int)floor(pos.x / (double)CHUNK_WIDTH);
-        int chunk_z = (int)floor(pos.z / (double)CHUNK_WIDTH);
-
-        if (!cached || cached_x != chunk_x || cached_z != chunk_z)
+        const Chunk* chunk = GetChunkForReading(ToChunkCoord(pos.x), ToChunkCoord(pos.z));
+        if (chunk == nullptr)
         {
-            auto it = terrain.find({ chunk_x, chunk_z });
-
-            if (it != terrain.end())
-            {
-                cached_x = chunk_x;
-                cached_z = chunk_z;
-                cached = it->second;
-            }
-            else
-            {
-                return 0;
-            }
+            return nullptr;
         }
-
-        return cached->GetSkyLight(Position((pos.x % CHUNK_WIDTH + CHUNK_WIDTH) % CHUNK_WIDTH, pos.y, (pos.z % CHUNK_WIDTH + CHUNK_WIDTH) % CHUNK_WIDTH));
+#if PROTOCOL_VERSION < 552
+        return chunk->GetBiomePtr(ToChunkLocalCoord(pos.x), ToChunkLocalCoord(pos.z));
+#else
+        return chunk->GetBiomePtr(ToChunkLocalCoord(pos.x), pos.y, ToChunkLocalCoord(pos.z));
+#endif
     }
 
-    const unsigned char World::GetBlockLight(const Position &pos)
+    const unsigned char World::GetSkyLight(const Position &pos) const
     {
-        int chunk_x = (int)floor(pos.x / (double)CHUNK_WIDTH);
-        int chunk_z = (int)floor(pos.z / (double)CHUNK_WIDTH);
-
-        if (!cached || cached_x != chunk_x || cached_z != chunk_z)
+        const Chunk* chunk = GetChunkForReading(ToChunkCoord(pos.x), ToChunkCoord(pos.z));
+        if (chunk == nullptr)
         {
-            auto it = terrain.find({ chunk_x, chunk_z });
-
-            if (it != terrain.end())
-            {
-                cached_x = chunk_x;
-                cached_z = chunk_z;
-                cached = it->second;
-            }
-            else
-            {
-                return 0;
-            }
+            return 0;
         }
+        return chunk->GetSkyLight(ToChunkLocalPosition(pos));
+    }
 
-        return cached->GetBlockLight(Position((pos.x % CHUNK_WIDTH + CHUNK_WIDTH) % CHUNK_WIDTH, pos.y, (pos.z % CHUNK_WIDTH + CHUNK_WIDTH) % CHUNK_WIDTH));
+    const unsigned char World::GetBlockLight(const Position &pos) const
+    {
+        const Chunk* chunk = GetChunkForReading(ToChunkCoord(pos.x), ToChunkCoord(pos.z));
+        if (chunk == nullptr)
+        {
+            return 0;
+        }
+        return chunk->GetBlockLight(ToChunkLocalPosition(pos));
     }
 
 #if PROTOCOL_VERSION < 719
-    const Dimension World::GetDimension(const int x, const int z)
+    const Dimension World::GetDimension(const int x, const int z) const
 #else
-    const std::string World::GetDimension(const int x, const int z)
+    const std::string World::GetDimension(const int x, const int z) const
 #endif
     {
-        if (!cached || cached_x != x || cached_z != z)
+        const Chunk* chunk = GetChunkForReading(x, z);
+        if (chunk == nullptr)
         {
-            auto it = terrain.find({ x, z });
-
-            if (it != terrain.end())
-            {
-                cached_x = x;
-                cached_z = z;
-                cached = it->second;
-            }
-            else
-            {
 #if PROTOCOL_VERSION < 719
-                return Dimension::None;
+            return Dimension::None;
 #else
-                return "";
+            return "";
 #endif
-            }
         }
-        return cached->GetDimension();
+        return chunk->GetDimension();
     }
 
 
-    const std::map<std::pair<int, int>, std::shared_ptr<Chunk> >& World::GetAllChunks() const
+    const int World::GetMinY() const
+    {
+        return current_min_y;
+    }
+
+    const int World::GetHeight() const
+    {
+        return current_height;
+    }
+
+#if PROTOCOL_VERSION > 754
+    void World::SetCurrentDimensionHeight(const ProtocolCraft::NBT& dimension_type)
+    {
+        std::shared_ptr<ProtocolCraft::TagInt> tag_min_y = std::dynamic_pointer_cast<ProtocolCraft::TagInt>(dimension_type.GetTag("min_y"));
+        std::shared_ptr<ProtocolCraft::TagInt> tag_height = std::dynamic_pointer_cast<ProtocolCraft::TagInt>(dimension_type.GetTag("height"));
+
+        if (tag_min_y == nullptr || tag_height == nullptr ||
+            tag_min_y->GetValue() % SECTION_HEIGHT != 0 || tag_height->GetValue() % SECTION_HEIGHT != 0 ||
+            tag_height->GetValue() <= 0)
+        {
+            std::cerr << "Warning, can't read dimension height, using default values" << std::endl;
+            current_min_y = CHUNK_MIN_Y;
+            current_height = CHUNK_HEIGHT;
+            return;
+        }
+
+        current_min_y = tag_min_y->GetValue();
+        current_height = tag_height->GetValue();
+    }
+#endif
+
+    const ChunkMap& World::GetAllChunks() const
     {
         return terrain;
     }
 
-    std::shared_ptr<Chunk> World::GetChunk(const int x, const int z)
+    const Chunk* World::GetChunkForReading(const int x, const int z) const
+    {
+        ThreadChunkCache& cache = thread_chunk_cache;
+        if (cache.world_id != world_id || cache.terrain_version != terrain_version)
+        {
+            cache.world_id = world_id;
+            cache.terrain_version = terrain_version;
+            for (int i = 0; i < cache.entries.size(); ++i)
+            {
+                cache.entries[i].valid = false;
+            }
+        }
+
+        ThreadChunkCacheEntry& entry = cache.entries[(x & (THREAD_CHUNK_CACHE_WIDTH - 1)) * THREAD_CHUNK_CACHE_WIDTH + (z & (THREAD_CHUNK_CACHE_WIDTH - 1))];
+        if (entry.valid && entry.x == x && entry.z == z)
+        {
+            return entry.chunk;
+        }
+
+        entry.valid = true;
+        entry.x = x;
+        entry.z = z;
+        entry.chunk = terrain.Get(x, z).get();
+
+        return entry.chunk;
+    }
+
+    std::shared_ptr<Chunk> World::GetChunk(const int x, const int z, const bool for_writing)
     {
         if (!cached || cached_x != x || cached_z != z)
         {
-            auto it = terrain.find({ x, z });
+            const std::shared_ptr<Chunk>& chunk = terrain.Get(x, z);
 
-            if (it != terrain.end())
+            if (chunk)
             {
                 cached_x = x;
                 cached_z = z;
-                cached = it->second;
+                cached = chunk;
             }
             else
             {
@@ -738,33 +1296,94 @@ namespace Botcraft
             }
         }
 
+        // If someone still has a snapshot of this chunk (from
+        // GetChunkCopy), copy it before any modification so
+        // they keep an unmodified version
+        if (for_writing && !chunk_snapshots.empty())
+        {
+            auto it = chunk_snapshots.find({ x, z });
+            if (it != chunk_snapshots.end())
+            {
+                if (it->second.lock().get() == cached.get())
+                {
+                    cached = std::shared_ptr<Chunk>(new Chunk(*cached));
+                    terrain.Set(x, z, cached);
+                    terrain_version++;
+                }
+                chunk_snapshots.erase(it);
+            }
+        }
+
         return cached;
     }
 
     void World::Handle(ProtocolCraft::ClientboundLoginPacket& msg)
     {
+        std::lock_guard<std::shared_mutex> world_guard(world_mutex);
 #if PROTOCOL_VERSION < 719
         current_dimension = (Dimension)msg.GetDimension();
 #else
         current_dimension = msg.GetDimension().GetName();
+#endif
+#if PROTOCOL_VERSION > 476
+        view_distance = msg.GetChunkRadius();
+#endif
+        has_view_center = false;
+#if PROTOCOL_VERSION > 754
+        SetCurrentDimensionHeight(msg.GetDimensionType());
 #endif
     }
 
     void World::Handle(ProtocolCraft::ClientboundRespawnPacket& msg)
     {
-        std::lock_guard<std::mutex> world_guard(world_mutex);
-        terrain = std::map<std::pair<int, int>, std::shared_ptr<Chunk> >();
+        std::shared_ptr<ChunkCache> cache;
+        std::vector<std::tuple<int, int, std::shared_ptr<Chunk> > > removed_chunks;
+        {
+            std::lock_guard<std::shared_mutex> world_guard(world_mutex);
+            cache = chunk_cache;
+
+            if (!change_subscriptions.empty())
+            {
+                std::vector<WorldChange> changes;
+                changes.reserve(terrain.size());
+                for (auto it = terrain.begin(); it != terrain.end(); ++it)
+                {
+                    changes.push_back(WorldChange{ WorldChangeType::ChunkUnloaded, Position(it->first.first, 0, it->first.second), 0, 0 });
+                }
+                PublishChanges(changes);
+            }
+
+            if (cache)
+            {
+                removed_chunks.reserve(terrain.size());
+                for (auto it = terrain.begin(); it != terrain.end(); ++it)
+                {
+                    removed_chunks.push_back({ it->first.first, it->first.second, it->second });
+                }
+            }
+            terrain.Clear();
+            terrain_version++;
+            chunk_snapshots.clear();
+            memory_usage = 0;
+            has_view_center = false;
+            cached = nullptr;
 
 #if PROTOCOL_VERSION < 719
-        current_dimension = (Dimension)msg.GetDimension();
+            current_dimension = (Dimension)msg.GetDimension();
 #else
-        current_dimension = msg.GetDimension().GetName();
+            current_dimension = msg.GetDimension().GetName();
 #endif
+#if PROTOCOL_VERSION > 754
+            SetCurrentDimensionHeight(msg.GetDimensionType());
+#endif
+        }
+
+        SaveRemovedChunks(cache, removed_chunks);
     }
 
     void World::Handle(ProtocolCraft::ClientboundBlockUpdatePacket& msg)
     {
-        std::lock_guard<std::mutex> world_guard(world_mutex);
+        std::lock_guard<std::shared_mutex> world_guard(world_mutex);
 #if PROTOCOL_VERSION < 347
         unsigned int id;
         unsigned char metadata;
@@ -778,113 +1397,205 @@ namespace Botcraft
     void World::Handle(ProtocolCraft::ClientboundSectionBlocksUpdatePacket& msg)
     {
 #if PROTOCOL_VERSION < 739
+        // Records are for the whole chunk, group them by section
+        std::map<int, std::pair<std::vector<short>, std::vector<int> > > section_updates;
         for (int i = 0; i < msg.GetRecordCount(); ++i)
         {
-            unsigned char x = (msg.GetRecords()[i].GetHorizontalPosition() >> 4) & 0x0F;
-            unsigned char z = msg.GetRecords()[i].GetHorizontalPosition() & 0x0F;
+            const unsigned char x = (msg.GetRecords()[i].GetHorizontalPosition() >> 4) & 0x0F;
+            const unsigned char z = msg.GetRecords()[i].GetHorizontalPosition() & 0x0F;
+            const unsigned char y = msg.GetRecords()[i].GetYCoordinate();
 
-            const int x_pos = CHUNK_WIDTH * msg.GetChunkX() + x;
-            const int y_pos = msg.GetRecords()[i].GetYCoordinate();
-            const int z_pos = CHUNK_WIDTH * msg.GetChunkZ() + z;
-#else
-        const int chunk_x = CHUNK_WIDTH * (msg.GetSectionPos() >> 42); // 22 bits
-        const int chunk_z = CHUNK_WIDTH * (msg.GetSectionPos() << 22 >> 42); // 22 bits
-        const int chunk_y = SECTION_HEIGHT * (msg.GetSectionPos() << 44 >> 44); // 20 bits
+            std::pair<std::vector<short>, std::vector<int> >& updates = section_updates[ToSectionCoord(y)];
+            updates.first.push_back(x << 8 | z << 4 | ToSectionLocalCoord(y));
+            updates.second.push_back(msg.GetRecords()[i].GetBlockId());
+        }
 
-        const size_t data_size = msg.GetPositions().size();
-        for (int i = 0; i < data_size; ++i)
+        for (auto it = section_updates.begin(); it != section_updates.end(); ++it)
         {
-            const unsigned int block_id = msg.GetStates()[i];
+            ApplySectionUpdates(msg.GetChunkX(), it->first, msg.GetChunkZ(), it->second.first, it->second.second);
+        }
+#else
+        const int chunk_x = static_cast<int>(msg.GetSectionPos() >> 42); // 22 bits
+        const int chunk_z = static_cast<int>(msg.GetSectionPos() << 22 >> 42); // 22 bits
+        const int section_y = static_cast<int>(msg.GetSectionPos() << 44 >> 44); // 20 bits
 
-            const int x_pos = chunk_x + ((msg.GetPositions()[i] >> 8) & 0xF);
-            const int z_pos = chunk_z + ((msg.GetPositions()[i] >> 4) & 0xF);
-            const int y_pos = chunk_y + ((msg.GetPositions()[i] >> 0) & 0xF);
+        ApplySectionUpdates(chunk_x, section_y, chunk_z, msg.GetPositions(), msg.GetStates());
 #endif
-            Position cube_pos(x_pos, y_pos, z_pos);
+    }
 
+    void World::Handle(ProtocolCraft::ClientboundForgetLevelChunkPacket& msg)
+    {
+        std::shared_ptr<ChunkCache> cache;
+        std::shared_ptr<Chunk> forgotten_chunk;
+        {
+            std::lock_guard<std::shared_mutex> world_guard(world_mutex);
+            cache = chunk_cache;
+            if (cache)
             {
-                std::lock_guard<std::mutex> world_guard(world_mutex);
-#if PROTOCOL_VERSION < 347
-                unsigned int id;
-                unsigned char metadata;
-                Blockstate::IdToIdMetadata(msg.GetRecords()[i].GetBlockId(), id, metadata);
-
-                SetBlock(cube_pos, id, metadata);
-#elif PROTOCOL_VERSION < 739
-                SetBlock(cube_pos, msg.GetRecords()[i].GetBlockId());
-#else
-                SetBlock(cube_pos, block_id);
-#endif
+                forgotten_chunk = GetChunk(msg.GetX(), msg.GetZ(), false);
             }
+            RemoveChunk(msg.GetX(), msg.GetZ());
         }
-    }
 
-    void World::Handle(ProtocolCraft::ClientboundForgetLevelChunkPacket& msg)
-    {
-        std::lock_guard<std::mutex> world_guard(world_mutex);
-        RemoveChunk(msg.GetX(), msg.GetZ());
+        // Spill the chunk to disk, it's not in the world
+        // anymore so it can be done without locking it
+        if (forgotten_chunk)
+        {
+            cache->Save(forgotten_chunk->GetDimension(), msg.GetX(), msg.GetZ(), *forgotten_chunk);
+        }
     }
 
     void World::Handle(ProtocolCraft::ClientboundLevelChunkPacket& msg)
     {
+        // When the world is shared, all the bots in the same area
+        // receive the same chunks. Only load them once
+        std::shared_ptr<ChunkCache> cache;
+        {
+            std::shared_lock<std::shared_mutex> world_guard(world_mutex);
+            cache = chunk_cache;
+        }
+        size_t data_hash = 0;
+#if PROTOCOL_VERSION < 755
+        if ((is_shared || cache) && msg.GetFullChunk())
+#else
+        if (is_shared || cache)
+#endif
+        {
+            data_hash = ChunkDataHash(msg);
+        }
+
 #if PROTOCOL_VERSION < 719
         Dimension chunk_dim;
+        Dimension dimension;
 #else
         std::string chunk_dim;
+        std::string dimension;
 #endif
+        // Current dimension, can be changed by a respawn
+        // as soon as the world is unlocked
+        int dimension_min_y;
+        int dimension_height;
+        // Selector used to index the new chunk blocks, if it's
+        // changed while decoding, the index is built again
+        BlockPredicate index_selector;
+        unsigned long long int index_selector_version;
         {
-            std::lock_guard<std::mutex> world_guard(world_mutex);
+            std::shared_lock<std::shared_mutex> world_guard(world_mutex);
             chunk_dim = GetDimension(msg.GetX(), msg.GetZ());
+            dimension = current_dimension;
+            dimension_min_y = current_min_y;
+            dimension_height = current_height;
+            index_selector = block_index_selector;
+            index_selector_version = block_index_selector_version;
+
+            if (data_hash != 0 && chunk_dim == dimension)
+            {
+                const Chunk* chunk = GetChunkForReading(msg.GetX(), msg.GetZ());
+                if (chunk && chunk->GetDataHash() == data_hash)
+                {
+                    return;
+                }
+            }
         }
 
+        // If we already saw this exact chunk, load it from the disk cache
+        // instead of decoding the network data again
+        if (cache && data_hash != 0 && cache->GetDataHash(dimension, msg.GetX(), msg.GetZ()) == data_hash)
+        {
+            std::shared_ptr<Chunk> cached_chunk = cache->Load(dimension, msg.GetX(), msg.GetZ());
+            if (cached_chunk &&
+                cached_chunk->GetMinY() == dimension_min_y && cached_chunk->GetHeight() == dimension_height)
+            {
+                std::vector<std::tuple<int, int, std::shared_ptr<Chunk> > > evicted_chunks;
+                {
+                    std::lock_guard<std::shared_mutex> world_guard(world_mutex);
+                    // Drop the chunk if we changed dimension while loading it
+                    if (current_dimension != dimension ||
+                        current_min_y != dimension_min_y || current_height != dimension_height)
+                    {
+                        return;
+                    }
+                    if (block_index_selector)
+                    {
+                        cached_chunk->BuildBlockIndex(&block_index_selector);
+                    }
+                    ReplaceChunk(msg.GetX(), msg.GetZ(), cached_chunk);
+                    evicted_chunks = EvictChunks();
+                }
+
+                SaveRemovedChunks(cache, evicted_chunks);
+                return;
+            }
+        }
+
+        std::vector<std::tuple<int, int, std::shared_ptr<Chunk> > > evicted_chunks;
 #if PROTOCOL_VERSION < 755
         if (msg.GetFullChunk())
+#endif
         {
+            // Full chunks are decoded in a new chunk without locking
+            // the world, so readers are only blocked during the swap
+            std::shared_ptr<Chunk> new_chunk(new Chunk(dimension_min_y, dimension_height, dimension));
+#if PROTOCOL_VERSION < 552
+            new_chunk->LoadChunkData(msg.GetBuffer(), msg.GetAvailableSections(), true);
+#else
+            new_chunk->LoadChunkData(msg.GetBuffer(), msg.GetAvailableSections());
+            new_chunk->SetBiomes(msg.GetBiomes());
 #endif
-            bool success = true;
-
-            if (chunk_dim != current_dimension)
+            new_chunk->LoadChunkBlockEntitiesData(msg.GetBlockEntitiesTags());
+            new_chunk->SetDataHash(data_hash);
+            if (index_selector)
             {
-                std::lock_guard<std::mutex> world_guard(world_mutex);
-                success = AddChunk(msg.GetX(), msg.GetZ(), current_dimension);
+                new_chunk->BuildBlockIndex(&index_selector);
             }
 
-            if (!success)
-            {
-                std::cerr << "Error adding chunk in pos : " << msg.GetX() << ", " << msg.GetZ() << " in dimension " <<
-#if PROTOCOL_VERSION < 719
-                    (int)current_dimension
-#else
-                    current_dimension
-#endif
-                    << std::endl;
-                return;
+            { // lock guard scope
+                std::lock_guard<std::shared_mutex> world_guard(world_mutex);
+                // Drop the chunk if we changed dimension while decoding it
+                if (current_dimension != dimension ||
+                    current_min_y != dimension_min_y || current_height != dimension_height)
+                {
+                    return;
+                }
+                if (block_index_selector_version != index_selector_version)
+                {
+                    new_chunk->BuildBlockIndex(block_index_selector ? &block_index_selector : nullptr);
+                }
+                ReplaceChunk(msg.GetX(), msg.GetZ(), new_chunk);
+                evicted_chunks = EvictChunks();
             }
-#if PROTOCOL_VERSION < 755
+
+            SaveRemovedChunks(cache, evicted_chunks);
+            return;
         }
-#endif
 
+#if PROTOCOL_VERSION < 755
+        // Partial chunks update the sections of the chunk already in the world
         { // lock guard scope
-            std::lock_guard<std::mutex> world_guard(world_mutex);
+            std::lock_guard<std::shared_mutex> world_guard(world_mutex);
 #if PROTOCOL_VERSION < 552
             LoadDataInChunk(msg.GetX(), msg.GetZ(), msg.GetBuffer(), msg.GetAvailableSections(), msg.GetFullChunk());
 #else
             LoadDataInChunk(msg.GetX(), msg.GetZ(), msg.GetBuffer(), msg.GetAvailableSections());
-#if PROTOCOL_VERSION < 755
-            if (msg.GetFullChunk())
-            {
-                LoadBiomesInChunk(msg.GetX(), msg.GetZ(), msg.GetBiomes());
-            }
-#else
-            LoadBiomesInChunk(msg.GetX(), msg.GetZ(), msg.GetBiomes());
-#endif
 #endif
             LoadBlockEntityDataInChunk(msg.GetX(), msg.GetZ(), msg.GetBlockEntitiesTags());
+
+            std::shared_ptr<Chunk> chunk = GetChunk(msg.GetX(), msg.GetZ(), false);
+            if (chunk)
+            {
+                // The chunk isn't the one received from the server anymore
+                chunk->SetDataHash(0);
+                UpdateChunkMemoryUsage(msg.GetX(), msg.GetZ());
+            }
+            evicted_chunks = EvictChunks();
         }
+
+        SaveRemovedChunks(cache, evicted_chunks);
+#endif
     }
 
     std::shared_ptr<Blockstate> World::Raycast(const Vector3<double> &origin, const Vector3<double> &direction,
-        const float max_radius, Position & out_pos, Position & out_normal)
+        const float max_radius, Position & out_pos, Position & out_normal) const
     {
         // Inspired from https://gist.github.com/dogfuntom/cc881c8fc86ad43d55d8
         // Searching along origin + t * direction line
@@ -945,19 +1656,16 @@ namespace Botcraft
         {
             const Block* block = GetBlock(out_pos);
 
-            if (block)
+            if (block && !block->GetProperties().air)
             {
-                std::shared_ptr<Blockstate> blockstate = block->GetBlockstate();
-                if (!block->GetBlockstate()->IsAir())
+                const std::shared_ptr<Blockstate> blockstate = block->GetBlockstate();
+                const auto& cubes = blockstate->GetModel(block->GetModelId()).GetColliders();
+                for (int i = 0; i < cubes.size(); ++i)
                 {
-                    const auto& cubes = blockstate->GetModel(block->GetModelId()).GetColliders();
-                    for (int i = 0; i < cubes.size(); ++i)
+                    const AABB current_cube = cubes[i] + out_pos;
+                    if (current_cube.Intersect(origin, direction))
                     {
-                        const AABB current_cube = cubes[i] + out_pos;
-                        if (current_cube.Intersect(origin, direction))
-                        {
-                            return blockstate;
-                        }
+                        return blockstate;
                     }
                 }
             }
@@ -1008,7 +1716,7 @@ namespace Botcraft
 #if PROTOCOL_VERSION > 404
     void World::Handle(ProtocolCraft::ClientboundLightUpdatePacket& msg)
     {
-        std::lock_guard<std::mutex> world_guard(world_mutex);
+        std::lock_guard<std::shared_mutex> world_guard(world_mutex);
         UpdateChunkLight(msg.GetX(), msg.GetZ(), current_dimension,
             msg.GetSkyYMask(), msg.GetEmptySkyYMask(), msg.GetSkyUpdates(), true);
         UpdateChunkLight(msg.GetX(), msg.GetZ(), current_dimension,
@@ -1018,8 +1726,23 @@ namespace Botcraft
 
     void World::Handle(ProtocolCraft::ClientboundBlockEntityDataPacket& msg)
     {
-        std::lock_guard<std::mutex> world_guard(world_mutex);
+        std::lock_guard<std::shared_mutex> world_guard(world_mutex);
         SetBlockEntityData(msg.GetPos(), msg.GetTag());
     }
 
+#if PROTOCOL_VERSION > 471
+    void World::Handle(ProtocolCraft::ClientboundSetChunkCacheCenterPacket& msg)
+    {
+        std::lock_guard<std::shared_mutex> world_guard(world_mutex);
+        view_center_x = msg.GetX();
+        view_center_z = msg.GetZ();
+        has_view_center = true;
+    }
+
+    void World::Handle(ProtocolCraft::ClientboundSetChunkCacheRadiusPacket& msg)
+    {
+        std::lock_guard<std::shared_mutex> world_guard(world_mutex);
+        view_distance = msg.GetRadius();
+    }
+#endif
 } // Botcraft
\ No newline at end of file
@@ -0,0 +1,61 @@
+#include "botcraft/Game/World/WorldChangeFeed.hpp"
+
+namespace Botcraft
+{
+    WorldChangeSubscription::WorldChangeSubscription(const size_t capacity_) : head(0), tail(0), overflow(false)
+    {
+        size_t capacity = 1;
+        while (capacity < capacity_)
+        {
+            capacity <<= 1;
+        }
+        buffer = std::vector<WorldChange>(capacity);
+        mask = capacity - 1;
+    }
+
+    bool WorldChangeSubscription::Poll(std::vector<WorldChange>& out)
+    {
+        size_t current_tail = tail.load(std::memory_order_relaxed);
+        const size_t current_head = head.load(std::memory_order_acquire);
+
+        out.reserve(out.size() + (current_head - current_tail));
+        for (; current_tail != current_head; ++current_tail)
+        {
+            out.push_back(buffer[current_tail & mask]);
+        }
+
+        // Release the slots to the producer
+        tail.store(current_tail, std::memory_order_release);
+
+        return !overflow.exchange(false, std::memory_order_acq_rel);
+    }
+
+    const size_t WorldChangeSubscription::GetCapacity() const
+    {
+        return buffer.size();
+    }
+
+    bool WorldChangeSubscription::Push(const std::vector<WorldChange>& changes)
+    {
+        const size_t current_head = head.load(std::memory_order_relaxed);
+        const size_t current_tail = tail.load(std::memory_order_acquire);
+
+        // Don't push half a batch, the consumer
+        // will have to rescan anyway
+        if (changes.size() > buffer.size() - (current_head - current_tail))
+        {
+            overflow.store(true, std::memory_order_release);
+            return false;
+        }
+
+        for (size_t i = 0; i < changes.size(); ++i)
+        {
+            buffer[(current_head + i) & mask] = changes[i];
+        }
+
+        // Publish the whole batch at once
+        head.store(current_head + changes.size(), std::memory_order_release);
+
+        return true;
+    }
+} // Botcraft
@@ -13,6 +13,9 @@ namespace Botcraft
 {
     AESEncrypter::AESEncrypter()
     {
+        encryption_context = nullptr;
+        decryption_context = nullptr;
+        blocksize = 0;
     }
 
     AESEncrypter::~AESEncrypter()
@@ -67,39 +70,43 @@ namespace Botcraft
     }
 
     std::vector<unsigned char> AESEncrypter::Encrypt(const std::vector<unsigned char>& in)
+    {
+        std::vector<unsigned char> output = in;
+        Encrypt(output.data(), output.size());
+        return output;
+    }
+
+    std::vector<unsigned char> AESEncrypter::Decrypt(const std::vector<unsigned char>& in)
+    {
+        std::vector<unsigned char> output = in;
+        Decrypt(output.data(), output.size());
+        return output;
+    }
+
+    void AESEncrypter::Encrypt(unsigned char* data, const size_t size)
     {
         if (encryption_context == nullptr)
         {
             std::cerr << "Warning, trying to encrypt packet while encryption is not initialized yet" << std::endl;
-            return in;
+            return;
         }
 
-        std::vector<unsigned char> output;
-        int size = 0;
-
-        output.resize(in.size() + blocksize);
-        EVP_EncryptUpdate(encryption_context, output.data(), &size, in.data(), in.size());
-        output.resize(size);
-
-        return output;
+        // CFB8 doesn't buffer anything, all the input is processed
+        // at once and it can be encrypted in place
+        int output_size = 0;
+        EVP_EncryptUpdate(encryption_context, data, &output_size, data, static_cast<int>(size));
     }
 
-    std::vector<unsigned char> AESEncrypter::Decrypt(const std::vector<unsigned char>& in)
+    void AESEncrypter::Decrypt(unsigned char* data, const size_t size)
     {
         if (decryption_context == nullptr)
         {
             std::cerr << "Warning, trying to decrypt packet while decryption is not initialized yet" << std::endl;
-            return in;
+            return;
         }
 
-        std::vector<unsigned char> output;
-        int size = 0;
-
-        output.resize(in.size() + blocksize);
-        EVP_DecryptUpdate(decryption_context, output.data(), &size, in.data(), in.size());
-        output.resize(size);
-
-        return output;
+        int output_size = 0;
+        EVP_DecryptUpdate(decryption_context, data, &output_size, data, static_cast<int>(size));
     }
 }
 #endif // USE_ENCRYPTION
\ No newline at end of file
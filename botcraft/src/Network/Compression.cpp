@@ -2,6 +2,9 @@
 
 #ifdef USE_COMPRESSION
 #include <zlib.h>
+#if USE_LIBDEFLATE
+#include <libdeflate.h>
+#endif
 #include <string>
 #include <cstring>
 #include <stdexcept>
@@ -9,6 +12,8 @@
 namespace Botcraft
 {
     const unsigned long MAX_COMPRESSED_PACKET_LEN = 200 * 1024;
+    // Maximum uncompressed size accepted by the server
+    const size_t MAX_DECOMPRESSED_PACKET_LEN = 8 * 1024 * 1024;
 
     std::vector<unsigned char> Compress(const std::vector<unsigned char> &raw, const int &start, const int &size)
     {
@@ -31,6 +36,28 @@ namespace Botcraft
         return std::vector<unsigned char>(compressedData.begin(), compressedData.begin() + compressedSize);
     }
 
+    void Compress(const unsigned char* data, const size_t size, std::vector<unsigned char>& out)
+    {
+        unsigned long compressedSize = compressBound(size);
+
+        if (compressedSize > MAX_COMPRESSED_PACKET_LEN)
+        {
+            throw(std::runtime_error("Incoming packet is too big"));
+        }
+
+        const size_t start = out.size();
+        out.resize(start + compressedSize);
+        int status = compress2(out.data() + start, &compressedSize, data, size, Z_DEFAULT_COMPRESSION);
+
+        if (status != Z_OK)
+        {
+            out.resize(start);
+            throw(std::runtime_error("Error compressing packet"));
+        }
+
+        out.resize(start + compressedSize);
+    }
+
     std::vector<unsigned char> Decompress(const std::vector<unsigned char> &compressed, const int &start, const int &size)
     {
         unsigned long size_to_decompress = size > 0 ? size : compressed.size() - start;
@@ -80,5 +107,85 @@ namespace Botcraft
             }
         }
     }
+
+#if USE_LIBDEFLATE
+    Decompressor::Decompressor()
+    {
+        decompressor = libdeflate_alloc_decompressor();
+        if (decompressor == nullptr)
+        {
+            throw(std::runtime_error("Error allocating libdeflate decompressor"));
+        }
+    }
+
+    Decompressor::~Decompressor()
+    {
+        libdeflate_free_decompressor(decompressor);
+    }
+
+    void Decompressor::Decompress(const unsigned char* data, const size_t size, const size_t uncompressed_size, std::vector<unsigned char>& out)
+    {
+        if (uncompressed_size > MAX_DECOMPRESSED_PACKET_LEN)
+        {
+            throw(std::runtime_error("Incoming packet is too big"));
+        }
+
+        out.resize(uncompressed_size);
+
+        // libdeflate decompresses the whole buffer at once,
+        // this is only possible because we know the output size
+        size_t actual_size = 0;
+        const libdeflate_result res = libdeflate_zlib_decompress(decompressor, data, size, out.data(), out.size(), &actual_size);
+        if (res != LIBDEFLATE_SUCCESS || actual_size != uncompressed_size)
+        {
+            throw(std::runtime_error("Libdeflate decompression failed"));
+        }
+    }
+#else
+    Decompressor::Decompressor()
+    {
+        stream = new z_stream;
+        memset(stream, 0, sizeof(z_stream));
+
+        const int res = inflateInit(stream);
+        if (res != Z_OK)
+        {
+            delete stream;
+            throw(std::runtime_error("inflateInit failed"));
+        }
+    }
+
+    Decompressor::~Decompressor()
+    {
+        inflateEnd(stream);
+        delete stream;
+    }
+
+    void Decompressor::Decompress(const unsigned char* data, const size_t size, const size_t uncompressed_size, std::vector<unsigned char>& out)
+    {
+        if (uncompressed_size > MAX_DECOMPRESSED_PACKET_LEN)
+        {
+            throw(std::runtime_error("Incoming packet is too big"));
+        }
+
+        out.resize(uncompressed_size);
+
+        // Reuse the stream allocated state instead of
+        // calling inflateInit/inflateEnd for each packet
+        inflateReset(stream);
+        stream->next_in = const_cast<unsigned char*>(data);
+        stream->avail_in = static_cast<unsigned int>(size);
+        stream->next_out = out.data();
+        stream->avail_out = static_cast<unsigned int>(out.size());
+
+        // Output buffer is already big enough, a
+        // single call decompresses the whole packet
+        const int res = inflate(stream, Z_FINISH);
+        if (res != Z_STREAM_END || stream->avail_out != 0)
+        {
+            throw(std::runtime_error("Inflate decompression failed" + (stream->msg == nullptr ? std::string() : ": " + std::string(stream->msg))));
+        }
+    }
+#endif
 } //Botcraft
 #endif
\ No newline at end of file
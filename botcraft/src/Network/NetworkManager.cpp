@@ -2,6 +2,7 @@
 
 #include "botcraft/Network/NetworkManager.hpp"
 #include "botcraft/Network/TCP_Com.hpp"
+#include "botcraft/Network/NetworkRuntime.hpp"
 #include "botcraft/Network/Authentifier.hpp"
 #include "botcraft/Network/AESEncrypter.hpp"
 
@@ -14,20 +15,30 @@
 
 namespace Botcraft
 {
-    NetworkManager::NetworkManager(const std::string& address, const std::string& login, const std::string& password, const std::string& launcher_accounts_path)
+    NetworkManager::NetworkManager(const std::string& address, const std::string& login, const std::string& password, const std::string& launcher_accounts_path,
+        const bool use_shared_runtime)
     {
         com = nullptr;
         authentifier = nullptr;
+        processing_scheduled = false;
+        batch_writes = false;
 
         compression = -1;
         AddHandler(this);
 
         state = ProtocolCraft::ConnectionState::Handshake;
 
-        //Start the thread to process the incoming packets
-        m_thread_process = std::thread(&NetworkManager::WaitForNewPackets, this);
+        if (use_shared_runtime)
+        {
+            runtime = NetworkRuntime::GetShared();
+        }
+        else
+        {
+            //Start the thread to process the incoming packets
+            m_thread_process = std::thread(&NetworkManager::WaitForNewPackets, this);
+        }
 
-        com = std::shared_ptr<TCP_Com>(new TCP_Com(address, std::bind(&NetworkManager::OnNewRawData, this, std::placeholders::_1)));
+        com = std::shared_ptr<TCP_Com>(new TCP_Com(address, std::bind(&NetworkManager::OnNewRawData, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3), runtime));
 
         //Let some time to initialize the communication before actually send data
         // TODO: make this in a cleaner way?
@@ -76,11 +87,17 @@ namespace Botcraft
     NetworkManager::NetworkManager(const ProtocolCraft::ConnectionState constant_connection_state)
     {
         state = constant_connection_state;
+        processing_scheduled = false;
+        batch_writes = false;
     }
 
     NetworkManager::~NetworkManager()
     {
-        state = ProtocolCraft::ConnectionState::None;
+        {
+            // Set under the lock so OnNewRawData sees it before scheduling
+            std::lock_guard<std::mutex> process_guard(mutex_process);
+            state = ProtocolCraft::ConnectionState::None;
+        }
 
         if (com)
         {
@@ -93,9 +110,19 @@ namespace Botcraft
         {
             m_thread_process.join();
         }
-        compression = -1;
+
+        // state is None so OnNewRawData won't schedule any new
+        // processing, but the one already scheduled on the runtime
+        // can still dispatch to handlers calling Send, so com must
+        // stay alive until it's done
+        if (runtime)
+        {
+            std::unique_lock<std::mutex> lck(mutex_process);
+            process_condition.wait(lck, [this] { return !processing_scheduled; });
+        }
 
         com.reset();
+        compression = -1;
     }
 
     void NetworkManager::AddHandler(ProtocolCraft::Handler* h)
@@ -108,27 +135,32 @@ namespace Botcraft
         if (com)
         {
             std::lock_guard<std::mutex> lock(mutex_send);
+            // Login packets are never delayed
+            const bool flush = !batch_writes || state != ProtocolCraft::ConnectionState::Play;
             std::vector<unsigned char> msg_data;
-            msg->Write(msg_data);
             if (compression == -1)
             {
-                com->SendPacket(msg_data);
+                msg->Write(msg_data);
+                com->SendPacket(std::move(msg_data), flush);
             }
             else
             {
 #ifdef USE_COMPRESSION
-                if (msg_data.size() < compression)
+                // 0 data length for uncompressed packets, written
+                // before the data so they don't have to be moved
+                msg_data.push_back(0x00);
+                msg->Write(msg_data);
+                const size_t data_length = msg_data.size() - 1;
+                if (data_length < compression)
                 {
-                    msg_data.insert(msg_data.begin(), 0x00);
-                    com->SendPacket(msg_data);
+                    com->SendPacket(std::move(msg_data), flush);
                 }
                 else
                 {
                     std::vector<unsigned char> compressed_msg;
-                    ProtocolCraft::WriteData<ProtocolCraft::VarInt>(msg_data.size(), compressed_msg);
-                    std::vector<unsigned char> compressed_data = Compress(msg_data);
-                    compressed_msg.insert(compressed_msg.end(), compressed_data.begin(), compressed_data.end());
-                    com->SendPacket(compressed_msg);
+                    ProtocolCraft::WriteData<ProtocolCraft::VarInt>(data_length, compressed_msg);
+                    Compress(msg_data.data() + 1, data_length, compressed_msg);
+                    com->SendPacket(std::move(compressed_msg), flush);
                 }
 #else
                 throw(std::runtime_error("Program compiled without ZLIB. Cannot send compressed message"));
@@ -137,6 +169,23 @@ namespace Botcraft
         }
     }
 
+    void NetworkManager::SetBatchWrites(const bool b)
+    {
+        batch_writes = b;
+        if (!b)
+        {
+            Flush();
+        }
+    }
+
+    void NetworkManager::Flush()
+    {
+        if (com)
+        {
+            com->Flush();
+        }
+    }
+
     const ProtocolCraft::ConnectionState NetworkManager::GetConnectionState() const
     {
         return state;
@@ -157,61 +206,105 @@ namespace Botcraft
             }
             while (!packets_to_process.empty())
             {
-                std::vector<unsigned char> packet;
+                RawPacket packet;
                 { // process_guard scope
                     std::lock_guard<std::mutex> process_guard(mutex_process);
                     if (!packets_to_process.empty())
                     {
-                        packet = packets_to_process.front();
+                        packet = std::move(packets_to_process.front());
                         packets_to_process.pop();
                     }
                 }
-                if (packet.size() > 0)
+                if (packet.buffer && packet.size > 0)
                 {
-                    if (compression == -1)
-                    {
-                        ProcessPacket(packet);
-                    }
-                    else
-                    {
+                    ProcessRawPacket(packet.buffer, packet.offset, packet.size);
+                }
+            }
+        }
+    }
+
+    void NetworkManager::ProcessQueuedPackets()
+    {
+        while (state != ProtocolCraft::ConnectionState::None)
+        {
+            RawPacket packet;
+            { // process_guard scope
+                std::lock_guard<std::mutex> process_guard(mutex_process);
+                if (packets_to_process.empty())
+                {
+                    processing_scheduled = false;
+                    process_condition.notify_all();
+                    return;
+                }
+                packet = std::move(packets_to_process.front());
+                packets_to_process.pop();
+            }
+            if (packet.buffer && packet.size > 0)
+            {
+                ProcessRawPacket(packet.buffer, packet.offset, packet.size);
+            }
+        }
+
+        std::lock_guard<std::mutex> process_guard(mutex_process);
+        processing_scheduled = false;
+        process_condition.notify_all();
+    }
+
+    void NetworkManager::ProcessRawPacket(const std::shared_ptr<const std::vector<unsigned char> >& buffer, const size_t offset, const size_t size)
+    {
+        if (compression == -1)
+        {
+            ProcessPacket(buffer, offset, size);
+        }
+        else
+        {
 #ifdef USE_COMPRESSION
-                        size_t length = packet.size();
-                        ProtocolCraft::ReadIterator iter = packet.begin();
-                        int data_length = ProtocolCraft::ReadData<ProtocolCraft::VarInt>(iter, length);
-
-                        //Packet not compressed
-                        if (data_length == 0)
-                        {
-                            //Erase the first 0
-                            packet.erase(packet.begin());
-                            ProcessPacket(packet);
-                        }
-                        //Packet compressed
-                        else
-                        {
-                            int size_varint = packet.size() - length;
-
-                            std::vector<unsigned char> uncompressed_msg = Decompress(packet, size_varint);
-                            ProcessPacket(uncompressed_msg);
-                        }
-#else
-                        throw(std::runtime_error("Program compiled without USE_COMPRESSION. Cannot read compressed message"));
-#endif
-                    }
+            size_t length = size;
+            ProtocolCraft::ReadIterator iter = buffer->begin() + offset;
+            int data_length = ProtocolCraft::ReadData<ProtocolCraft::VarInt>(iter, length);
+
+            //Packet not compressed
+            if (data_length == 0)
+            {
+                //Skip the first 0
+                ProcessPacket(buffer, offset + 1, size - 1);
+            }
+            //Packet compressed
+            else
+            {
+                int size_varint = size - length;
+
+                if (data_length < 0)
+                {
+                    throw(std::runtime_error("Invalid uncompressed packet length"));
                 }
+
+                if (decompressor == nullptr)
+                {
+                    decompressor = std::unique_ptr<Decompressor>(new Decompressor());
+                }
+
+                // data_length is the uncompressed size, the output
+                // buffer is allocated only once with the right size
+                std::shared_ptr<std::vector<unsigned char> > decompressed = std::make_shared<std::vector<unsigned char> >();
+                decompressor->Decompress(buffer->data() + offset + size_varint, size - size_varint, data_length, *decompressed);
+                ProcessPacket(decompressed, 0, decompressed->size());
             }
+#else
+            throw(std::runtime_error("Program compiled without USE_COMPRESSION. Cannot read compressed message"));
+#endif
         }
     }
 
-    void NetworkManager::ProcessPacket(const std::vector<unsigned char>& packet)
+    void NetworkManager::ProcessPacket(const std::shared_ptr<const std::vector<unsigned char> >& packet, const size_t offset, const size_t size)
     {
-        if (packet.empty())
+        if (size == 0 || packet->size() < offset + size)
         {
             return;
         }
 
-        std::vector<unsigned char>::const_iterator packet_iterator = packet.begin();
-        size_t length = packet.size();
+        std::vector<unsigned char>::const_iterator packet_iterator = packet->begin() + offset;
+        size_t length = size;
 
         int packet_id = ProtocolCraft::ReadData<ProtocolCraft::VarInt>(packet_iterator, length);
 
@@ -219,7 +312,10 @@ namespace Botcraft
 
         if (msg)
         {
-            msg->Read(packet_iterator, length);
+            { // shared buffer scope
+                ProtocolCraft::SharedReadBufferScope shared_buffer(packet);
+                msg->Read(packet_iterator, length);
+            }
             for (int i = 0; i < subscribed.size(); i++)
             {
                 msg->Dispatch(subscribed[i]);
@@ -227,11 +323,26 @@ namespace Botcraft
         }
     }
     
-    void NetworkManager::OnNewRawData(const std::vector<unsigned char>& packet)
+    void NetworkManager::OnNewRawData(const std::shared_ptr<const std::vector<unsigned char> >& buffer, const size_t offset, const size_t size)
     {
         std::unique_lock<std::mutex> lck(mutex_process);
-        packets_to_process.push(packet);
-        process_condition.notify_all();
+        packets_to_process.push(RawPacket{ buffer, offset, size });
+        if (runtime == nullptr)
+        {
+            process_condition.notify_all();
+        }
+        // Only one processing task at a time so the
+        // packets are processed one by one, in order
+        else if (!processing_scheduled && state != ProtocolCraft::ConnectionState::None)
+        {
+            processing_scheduled = true;
+            asio::post(runtime->GetContext(), std::bind(&NetworkManager::ProcessQueuedPackets, this));
+        }
+    }
+
+    void NetworkManager::SetSharedRuntimeThreadCount(const unsigned int num_threads)
+    {
+        NetworkRuntime::SetSharedThreadCount(num_threads);
     }
 
     void NetworkManager::Handle(ProtocolCraft::Message& msg)
@@ -0,0 +1,67 @@
+#include <mutex>
+#include <iostream>
+#include <algorithm>
+
+#include "botcraft/Network/NetworkRuntime.hpp"
+
+namespace Botcraft
+{
+    static std::mutex shared_runtime_mutex;
+    static std::weak_ptr<NetworkRuntime> shared_runtime;
+    static unsigned int shared_runtime_threads = 0;
+
+    NetworkRuntime::NetworkRuntime(const unsigned int num_threads)
+        : work_guard(asio::make_work_guard(io_context))
+    {
+        const unsigned int actual_num_threads = std::max(1u, num_threads);
+        threads.reserve(actual_num_threads);
+        for (unsigned int i = 0; i < actual_num_threads; ++i)
+        {
+            threads.push_back(std::thread([this] { io_context.run(); }));
+        }
+    }
+
+    NetworkRuntime::~NetworkRuntime()
+    {
+        // All the connections using this runtime are closed,
+        // the threads can stop once the queue is empty
+        work_guard.reset();
+        for (int i = 0; i < threads.size(); ++i)
+        {
+            if (threads[i].joinable())
+            {
+                threads[i].join();
+            }
+        }
+    }
+
+    std::shared_ptr<NetworkRuntime> NetworkRuntime::GetShared()
+    {
+        std::lock_guard<std::mutex> shared_runtime_guard(shared_runtime_mutex);
+        std::shared_ptr<NetworkRuntime> runtime = shared_runtime.lock();
+        if (runtime == nullptr)
+        {
+            const unsigned int num_threads = shared_runtime_threads == 0 ? std::thread::hardware_concurrency() : shared_runtime_threads;
+            runtime = std::make_shared<NetworkRuntime>(num_threads);
+            shared_runtime = runtime;
+            std::cout << "Shared network runtime started with " << runtime->GetThreadCount() << " threads" << std::endl;
+        }
+        return runtime;
+    }
+
+    void NetworkRuntime::SetSharedThreadCount(const unsigned int num_threads)
+    {
+        std::lock_guard<std::mutex> shared_runtime_guard(shared_runtime_mutex);
+        shared_runtime_threads = num_threads;
+    }
+
+    asio::io_context& NetworkRuntime::GetContext()
+    {
+        return io_context;
+    }
+
+    const unsigned int NetworkRuntime::GetThreadCount() const
+    {
+        return static_cast<unsigned int>(threads.size());
+    }
+} // Botcraft
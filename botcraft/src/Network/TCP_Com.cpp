@@ -1,10 +1,14 @@
 #include <iterator>
 #include <iostream>
 #include <functional>
+#include <algorithm>
+#include <cstring>
+#include <atomic>
 
 #include "protocolCraft/BinaryReadWrite.hpp"
 
 #include "botcraft/Network/TCP_Com.hpp"
+#include "botcraft/Network/NetworkRuntime.hpp"
 #include "botcraft/Utilities/StringUtilities.hpp"
 #include "botcraft/Network/DNS/DNSMessage.hpp"
 #include "botcraft/Network/DNS/DNSSrvData.hpp"
@@ -15,23 +19,113 @@
 
 namespace Botcraft
 {
+    // Default size of the read buffers, and minimum
+    // room left for each read in the current buffer
+    static const size_t READ_BUFFER_SIZE = 64 * 1024;
+    static const size_t MIN_READ_SIZE = 4 * 1024;
+    // Packets can't be bigger than 2^21 - 1 bytes,
+    // their length is a VarInt of at most 3 bytes
+    static const size_t MAX_PACKET_SIZE = (1 << 21) - 1;
+    static const int MAX_PACKET_LENGTH_BYTES = 3;
+    // Queued packets are sent without waiting for a flush
+    // once they are at least this size in total
+    static const size_t MAX_QUEUED_OUTPUT_SIZE = 64 * 1024;
+
+    // Read the VarInt packet length at the beginning of data.
+    // Return the number of bytes of the VarInt, 0 if it's
+    // incomplete and -1 if it's not a valid packet length
+    static const int ReadPacketLength(const unsigned char* data, const size_t available, size_t& packet_length)
+    {
+        packet_length = 0;
+        for (int i = 0; i < MAX_PACKET_LENGTH_BYTES; ++i)
+        {
+            if (i == available)
+            {
+                return 0;
+            }
+            packet_length |= static_cast<size_t>(data[i] & 0x7F) << (7 * i);
+            if ((data[i] & 0x80) == 0)
+            {
+                return i + 1;
+            }
+        }
+        return -1;
+    }
+
+    // Write packet_length as a VarInt in data (at least 5 bytes).
+    // Return the number of bytes written
+    static const size_t WritePacketLength(const size_t packet_length, unsigned char* data)
+    {
+        size_t value = packet_length;
+        size_t i = 0;
+        do
+        {
+            data[i] = value & 0x7F;
+            value >>= 7;
+            if (value != 0)
+            {
+                data[i] |= 0x80;
+            }
+            ++i;
+        } while (value != 0);
+        return i;
+    }
+
+    template <typename Handler>
+    auto TCP_Com::Track(Handler handler)
+    {
+        pending_operations++;
+        return asio::bind_executor(strand,
+            [this, handler](auto&&... args) mutable
+            {
+                handler(std::forward<decltype(args)>(args)...);
+                OperationDone();
+            });
+    }
+
+    void TCP_Com::OperationDone()
+    {
+        // Decrement with the mutex locked, otherwise the destructor could
+        // see 0 and destroy the object before we notify the condition
+        std::lock_guard<std::mutex> lock(mutex_operations);
+        if (--pending_operations == 0)
+        {
+            operations_condition.notify_all();
+        }
+    }
+
     TCP_Com::TCP_Com(const std::string &address,
-        std::function<void(const std::vector<unsigned char>&)> callback)
-        : socket(io_service)
+        std::function<void(const std::shared_ptr<const std::vector<unsigned char> >&, const size_t, const size_t)> callback,
+        const std::shared_ptr<NetworkRuntime>& runtime_)
+        : runtime(runtime_),
+        own_io_context(runtime_ ? nullptr : new asio::io_context()),
+        io_context(runtime_ ? runtime_->GetContext() : *own_io_context),
+        strand(asio::make_strand(io_context)),
+        socket(io_context),
+        pending_operations(0)
     {
         NewPacketCallback = callback;
+        read_buffer = std::make_shared<std::vector<unsigned char> >(READ_BUFFER_SIZE);
+        read_start = 0;
+        read_end = 0;
+        queued_output_size = 0;
+        flush_requested = false;
+        write_in_progress = false;
 
         SetIPAndPortFromAddress(address);
 
-        asio::ip::tcp::resolver resolver(io_service);
+        asio::ip::tcp::resolver resolver(io_context);
         asio::ip::tcp::resolver::query query(ip, std::to_string(port));
         asio::ip::tcp::resolver::iterator iterator = resolver.resolve(query);
         std::cout << "Trying to connect to " << ip << ":" << port << std::endl;
         asio::async_connect(socket, iterator,
-            std::bind(&TCP_Com::handle_connect, this,
-            std::placeholders::_1));
+            Track(std::bind(&TCP_Com::handle_connect, this,
+            std::placeholders::_1)));
 
-        thread_com = std::thread([&] { io_service.run(); });
+        if (runtime == nullptr)
+        {
+            thread_com = std::thread([&] { io_context.run(); });
+        }
     }
 
     TCP_Com::~TCP_Com()
@@ -40,27 +134,57 @@ namespace Botcraft
         {
             thread_com.join();
         }
+
+        // The thread stops as soon as there is nothing left to do (e.g.
+        // when the server closes the connection), handlers posted after
+        // that (close, writes) still have to be executed
+        if (own_io_context != nullptr)
+        {
+            own_io_context->restart();
+            own_io_context->run();
+        }
+
+        // On the shared runtime, handlers can still be running
+        // on other threads, wait for all of them to be done
+        std::unique_lock<std::mutex> lock(mutex_operations);
+        operations_condition.wait(lock, [this] { return pending_operations == 0; });
     }
 
-    void TCP_Com::SendPacket(const std::vector<unsigned char>& msg)
+    void TCP_Com::SendPacket(std::vector<unsigned char>&& msg, const bool flush)
     {
-        std::vector<unsigned char> sized_packet;
-        ProtocolCraft::WriteData<ProtocolCraft::VarInt>(msg.size(), sized_packet);
-        sized_packet.insert(sized_packet.end(), msg.begin(), msg.end());
+        OutputFrame frame;
+        frame.header_size = WritePacketLength(msg.size(), frame.header);
+        frame.data = std::move(msg);
 
+        std::lock_guard<std::mutex> output_guard(mutex_output);
 #ifdef USE_ENCRYPTION
+        // Packets must be encrypted in the order they are sent
         if (encrypter != nullptr)
         {
-            std::vector<unsigned char> encrypted = encrypter->Encrypt(sized_packet);
-            io_service.post(std::bind(&TCP_Com::do_write, this, encrypted));
+            encrypter->Encrypt(frame.header, frame.header_size);
+            encrypter->Encrypt(frame.data.data(), frame.data.size());
         }
-        else
+#endif
+        queued_output_size += frame.header_size + frame.data.size();
+        queued_output.push_back(std::move(frame));
+
+        // If a flush is already requested, do_write is either
+        // posted or will be called at the end of the current write
+        if (!flush_requested && (flush || queued_output_size >= MAX_QUEUED_OUTPUT_SIZE))
         {
-            io_service.post(std::bind(&TCP_Com::do_write, this, sized_packet));
+            flush_requested = true;
+            asio::post(strand, Track(std::bind(&TCP_Com::do_write, this)));
+        }
+    }
+
+    void TCP_Com::Flush()
+    {
+        std::lock_guard<std::mutex> output_guard(mutex_output);
+        if (!flush_requested && !queued_output.empty())
+        {
+            flush_requested = true;
+            asio::post(strand, Track(std::bind(&TCP_Com::do_write, this)));
         }
-#else
-        io_service.post(std::bind(&TCP_Com::do_write, this, sized_packet));
-#endif
     }
 
 #ifdef USE_ENCRYPTION
@@ -82,7 +206,7 @@ namespace Botcraft
 
     void TCP_Com::close()
     {
-        io_service.post(std::bind(&TCP_Com::do_close, this));
+        asio::post(strand, Track(std::bind(&TCP_Com::do_close, this)));
     }
 
     void TCP_Com::handle_connect(const asio::error_code& error)
@@ -90,9 +214,7 @@ namespace Botcraft
         if (!error)
         {
             std::cout << "Connected to server." << std::endl;
-            socket.async_read_some(asio::buffer(read_msg.data(), read_msg.size()),
-                std::bind(&TCP_Com::handle_read, this,
-                std::placeholders::_1, std::placeholders::_2));
+            do_read();
         }
         else
         {
@@ -107,60 +229,41 @@ namespace Botcraft
 #ifdef USE_ENCRYPTION
             if (encrypter != nullptr)
             {
-                std::vector<unsigned char> decrypted(bytes_transferred);
-                std::copy_n(read_msg.begin(), bytes_transferred, decrypted.data());
-                decrypted = encrypter->Decrypt(decrypted);
-                for (int i = 0; i < decrypted.size(); ++i)
-                {
-                    input_msg.push_back(decrypted[i]);
-                }
-            }
-            else
-            {
-                for (int i = 0; i < bytes_transferred; ++i)
-                {
-                    input_msg.push_back(read_msg[i]);
-                }
-            }
-#else
-            for (int i = 0; i < bytes_transferred; ++i)
-            {
-                input_msg.push_back(read_msg[i]);
+                // New data are after all the packets given to the
+                // callback, no one else can read them yet
+                encrypter->Decrypt(read_buffer->data() + read_end, bytes_transferred);
             }
 #endif
+            read_end += bytes_transferred;
 
-            while (input_msg.size() != 0)
+            // Give all the complete packets to the callback
+            // as slices of the buffer, without copying them
+            while (read_start < read_end)
             {
-                std::vector<unsigned char>::const_iterator read_iter = input_msg.begin();
-                size_t max_length = input_msg.size();
-                int packet_length;
-                try
-                {
-                    packet_length = ProtocolCraft::ReadData<ProtocolCraft::VarInt>(read_iter, max_length);
-                }
-                catch (const std::runtime_error &e)
+                size_t packet_length;
+                const int length_bytes = ReadPacketLength(read_buffer->data() + read_start, read_end - read_start, packet_length);
+                if (length_bytes == 0)
                 {
                     break;
                 }
-                int bytes_read = std::distance<std::vector<unsigned char>::const_iterator>(input_msg.begin(), read_iter);
-                std::vector<unsigned char> data_packet;
 
-                if (packet_length > 0 && input_msg.size() >= bytes_read + packet_length)
+                if (length_bytes < 0 || packet_length == 0 || packet_length > MAX_PACKET_SIZE)
                 {
-                    data_packet = std::vector<unsigned char>(input_msg.begin() + bytes_read, input_msg.begin() + bytes_read + packet_length);
-
-                    NewPacketCallback(data_packet);
-                    input_msg.erase(input_msg.begin(), input_msg.begin() + bytes_read + packet_length);
+                    std::cerr << "Error, invalid packet length received, closing connection" << std::endl;
+                    do_close();
+                    return;
                 }
-                else
+
+                if (read_end - read_start < length_bytes + packet_length)
                 {
                     break;
                 }
+
+                NewPacketCallback(read_buffer, read_start + length_bytes, packet_length);
+                read_start += length_bytes + packet_length;
             }
 
-            socket.async_read_some(asio::buffer(read_msg.data(), read_msg.size()),
-                std::bind(&TCP_Com::handle_read, this,
-                std::placeholders::_1, std::placeholders::_2));
+            do_read();
         }
         else
         {
@@ -168,39 +271,104 @@ namespace Botcraft
         }
     }
 
-    void TCP_Com::do_write(const std::vector<unsigned char> &msg)
+    void TCP_Com::PrepareReadBuffer()
     {
-        mutex_output.lock();
-        bool write_in_progress = !output_msg.empty();
-        output_msg.push_back(msg);
-        mutex_output.unlock();
+        const size_t pending = read_end - read_start;
+
+        // Total size of the incomplete packet if it's already known
+        size_t required = pending;
+        size_t packet_length;
+        const int length_bytes = ReadPacketLength(read_buffer->data() + read_start, pending, packet_length);
+        if (length_bytes > 0)
+        {
+            required = length_bytes + packet_length;
+        }
+
+        if (read_buffer->size() - read_end >= MIN_READ_SIZE &&
+            read_buffer->size() - read_start >= required)
+        {
+            return;
+        }
 
-        if (!write_in_progress)
+        const size_t new_size = std::max(READ_BUFFER_SIZE, required + MIN_READ_SIZE);
+        // If no packet references the buffer anymore
+        // and it's big enough, reuse it
+        if (read_buffer.use_count() == 1 && read_buffer->size() >= new_size)
+        {
+            // use_count is a relaxed load, the last packet may have been
+            // released on another thread, make sure its reads are done
+            std::atomic_thread_fence(std::memory_order_acquire);
+            std::memmove(read_buffer->data(), read_buffer->data() + read_start, pending);
+        }
+        else
         {
-            asio::async_write(socket,
-                asio::buffer(output_msg.front().data(),
-                output_msg.front().size()),
-                std::bind(&TCP_Com::handle_write, this,
-                std::placeholders::_1));
+            std::shared_ptr<std::vector<unsigned char> > new_buffer = std::make_shared<std::vector<unsigned char> >(new_size);
+            std::memcpy(new_buffer->data(), read_buffer->data() + read_start, pending);
+            read_buffer = new_buffer;
         }
+        read_start = 0;
+        read_end = pending;
     }
 
-    void TCP_Com::handle_write(const asio::error_code& error)
+    void TCP_Com::do_read()
     {
-        if (!error)
+        PrepareReadBuffer();
+        socket.async_read_some(asio::buffer(read_buffer->data() + read_end, read_buffer->size() - read_end),
+            Track(std::bind(&TCP_Com::handle_read, this,
+            std::placeholders::_1, std::placeholders::_2)));
+    }
+
+    void TCP_Com::do_write()
+    {
+        // handle_write will call it again when the current write is done
+        if (write_in_progress)
         {
-            mutex_output.lock();
-            output_msg.pop_front();
-            mutex_output.unlock();
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> output_guard(mutex_output);
+            if (!flush_requested)
+            {
+                return;
+            }
+            flush_requested = false;
+            // Swap to keep the capacity of both vectors
+            std::swap(queued_output, writing_output);
+            queued_output_size = 0;
+        }
+
+        if (writing_output.empty())
+        {
+            return;
+        }
 
-            if (!output_msg.empty())
+        // Send all the frames with one gather write
+        write_buffers.clear();
+        write_buffers.reserve(2 * writing_output.size());
+        for (int i = 0; i < writing_output.size(); ++i)
+        {
+            if (writing_output[i].header_size > 0)
             {
-                asio::async_write(socket,
-                    asio::buffer(output_msg.front().data(),
-                    output_msg.front().size()),
-                    std::bind(&TCP_Com::handle_write, this,
-                    std::placeholders::_1));
+                write_buffers.push_back(asio::buffer(writing_output[i].header, writing_output[i].header_size));
             }
+            write_buffers.push_back(asio::buffer(writing_output[i].data));
+        }
+
+        write_in_progress = true;
+        asio::async_write(socket, write_buffers,
+            Track(std::bind(&TCP_Com::handle_write, this,
+            std::placeholders::_1)));
+    }
+
+    void TCP_Com::handle_write(const asio::error_code& error)
+    {
+        write_in_progress = false;
+        writing_output.clear();
+
+        if (!error)
+        {
+            do_write();
         }
         else
         {
@@ -242,7 +410,7 @@ namespace Botcraft
 
         // If port is unknown we first try a SRV DNS lookup
         std::cout << "Performing SRV DNS lookup on " << "_minecraft._tcp." << address << " to find an endpoint" << std::endl;
-        asio::ip::udp::socket udp_socket(io_service);
+        asio::ip::udp::socket udp_socket(io_context);
 
         // Create the query
         DNSMessage query;
@@ -142,17 +142,16 @@ namespace Botcraft
             }
         }
 
-        void WorldRenderer::UpdateChunk(const int x_, const int z_, const std::shared_ptr<const Botcraft::Chunk> chunk)
+        void WorldRenderer::UpdateChunk(const int x_, const int z_, const std::shared_ptr<const Botcraft::Chunk> chunk,
+            const std::array<std::shared_ptr<const Botcraft::Chunk>, 4>& neighbour_chunks)
         {
             // Remove any previous version of this chunk
+            // (its height can be different from the new one)
             {
                 std::lock_guard<std::mutex> lock(chunks_mutex);
-                Position pos(x_, 0, z_);
-                for (int y = 0; y < CHUNK_HEIGHT / section_height; ++y)
+                for (auto it = chunks.begin(); it != chunks.end(); ++it)
                 {
-                    pos.y = y;
-                    auto it = chunks.find(pos);
-                    if (it != chunks.end())
+                    if (it->first.x == x_ && it->first.z == z_)
                     {
                         it->second->ClearFaces();
                     }
@@ -160,12 +159,9 @@ namespace Botcraft
             }
             {
                 std::lock_guard<std::mutex> lock(transparent_chunks_mutex);
-                Position pos(x_, 0, z_);
-                for (int y = 0; y < CHUNK_HEIGHT / CHUNK_WIDTH; ++y)
+                for (auto it = transparent_chunks.begin(); it != transparent_chunks.end(); ++it)
                 {
-                    pos.y = y;
-                    auto it = transparent_chunks.find(pos);
-                    if (it != transparent_chunks.end())
+                    if (it->first.x == x_ && it->first.z == z_)
                     {
                         it->second->ClearFaces();
                     }
@@ -189,7 +185,7 @@ namespace Botcraft
             std::vector<unsigned char> neighbour_model_ids(6);
 
             Position pos;
-            for (int y = 0; y < CHUNK_HEIGHT; ++y)
+            for (int y = chunk->GetMinY(); y < chunk->GetMinY() + chunk->GetHeight(); ++y)
             {
                 pos.y = y;
                 for (int z = 0; z < CHUNK_WIDTH; ++z)
@@ -202,7 +198,7 @@ namespace Botcraft
                         // If this block is air, just skip it
                         const Block* this_block = chunk->GetBlock(pos);
                         if (this_block == nullptr ||
-                            this_block->GetBlockstate()->IsAir())
+                            this_block->GetProperties().air)
                         {
                             continue;
                         }
@@ -210,7 +206,33 @@ namespace Botcraft
                         // Else check its neighbours to find which face to draw
                         for (int i = 0; i < 6; ++i)
                         {
-                            const Block* neighbour_block = chunk->GetBlock(pos + neighbour_positions[i]);
+                            Position neighbour_pos = pos + neighbour_positions[i];
+                            const Block* neighbour_block = nullptr;
+                            // Blocks on the other side of the border are read in the neighbour chunk
+                            if (neighbour_pos.x < 0)
+                            {
+                                neighbour_pos.x += CHUNK_WIDTH;
+                                neighbour_block = neighbour_chunks[0] ? neighbour_chunks[0]->GetBlock(neighbour_pos) : nullptr;
+                            }
+                            else if (neighbour_pos.x > CHUNK_WIDTH - 1)
+                            {
+                                neighbour_pos.x -= CHUNK_WIDTH;
+                                neighbour_block = neighbour_chunks[1] ? neighbour_chunks[1]->GetBlock(neighbour_pos) : nullptr;
+                            }
+                            else if (neighbour_pos.z < 0)
+                            {
+                                neighbour_pos.z += CHUNK_WIDTH;
+                                neighbour_block = neighbour_chunks[2] ? neighbour_chunks[2]->GetBlock(neighbour_pos) : nullptr;
+                            }
+                            else if (neighbour_pos.z > CHUNK_WIDTH - 1)
+                            {
+                                neighbour_pos.z -= CHUNK_WIDTH;
+                                neighbour_block = neighbour_chunks[3] ? neighbour_chunks[3]->GetBlock(neighbour_pos) : nullptr;
+                            }
+                            else
+                            {
+                                neighbour_block = chunk->GetBlock(neighbour_pos);
+                            }
                             if (neighbour_block == nullptr)
                             {
                                 neighbour_blockstates[i] = nullptr;
@@ -243,9 +265,9 @@ namespace Botcraft
                         //Add all faces of the current state
                         const std::vector<FaceDescriptor>& current_faces = this_block->GetBlockstate()->GetModel(this_block->GetModelId()).GetFaces();
 #if PROTOCOL_VERSION < 552
-                        const std::shared_ptr<Biome> current_biome = AssetsManager_.GetBiome(chunk->GetBiome(x, z));
+                        const Biome* current_biome = chunk->GetBiomePtr(x, z);
 #else
-                        const std::shared_ptr<Biome> current_biome = AssetsManager_.GetBiome(chunk->GetBiome(x, y, z));
+                        const Biome* current_biome = chunk->GetBiomePtr(x, y, z);
 #endif
 
                         for (int i = 0; i < current_faces.size(); ++i)
@@ -493,7 +515,7 @@ namespace Botcraft
                 face.SetDisplayBackface(false);
             }
 
-            const Position position((int)floor(x_ / (double)CHUNK_WIDTH), (int)floor(y_ / (double)section_height), (int)floor(z_ / (double)CHUNK_WIDTH));
+            const Position position(ToChunkCoord(x_), (int)floor(y_ / (double)section_height), ToChunkCoord(z_));
 
             if (transparency == Transparency::Partial)
             {
@@ -517,7 +539,7 @@ namespace Botcraft
             }
         }
 
-        const std::vector<unsigned int> WorldRenderer::GetColorModifier(const int y, const std::shared_ptr<Biome> biome, const std::shared_ptr<Blockstate> blockstate, const std::vector<bool>& use_tintindex) const
+        const std::vector<unsigned int> WorldRenderer::GetColorModifier(const int y, const Biome* biome, const std::shared_ptr<Blockstate> blockstate, const std::vector<bool>& use_tintindex) const
         {
             std::vector<unsigned int> texture_modifier(use_tintindex.size(), 0xFFFFFFFF);
             for (int i = 0; i < use_tintindex.size(); ++i)
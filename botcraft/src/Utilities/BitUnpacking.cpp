@@ -0,0 +1,183 @@
+#include "botcraft/Utilities/BitUnpacking.hpp"
+
+#include <cstring>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace Botcraft
+{
+    void BigEndianLongsToHost(const unsigned char* src, const size_t count, unsigned long long int* dst)
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            const unsigned char* bytes = src + 8 * i;
+            dst[i] = static_cast<unsigned long long int>(bytes[0]) << 56 |
+                static_cast<unsigned long long int>(bytes[1]) << 48 |
+                static_cast<unsigned long long int>(bytes[2]) << 40 |
+                static_cast<unsigned long long int>(bytes[3]) << 32 |
+                static_cast<unsigned long long int>(bytes[4]) << 24 |
+                static_cast<unsigned long long int>(bytes[5]) << 16 |
+                static_cast<unsigned long long int>(bytes[6]) << 8 |
+                static_cast<unsigned long long int>(bytes[7]);
+        }
+    }
+
+    // Unpack entries [first, last[ one by one
+    void UnpackBitsScalar(const unsigned long long int* data, const unsigned char bits_per_entry, const bool spanning,
+        const size_t first, const size_t last, unsigned short* out)
+    {
+        if (first >= last)
+        {
+            return;
+        }
+
+        const unsigned long long int mask = (1ULL << bits_per_entry) - 1;
+
+        if (spanning)
+        {
+            size_t bit_offset = first * bits_per_entry;
+            for (size_t i = first; i < last; ++i)
+            {
+                const size_t long_index = bit_offset >> 6;
+                const unsigned int start_offset = bit_offset & 63;
+                unsigned long long int value = data[long_index] >> start_offset;
+                if (start_offset + bits_per_entry > 64)
+                {
+                    value |= data[long_index + 1] << (64 - start_offset);
+                }
+                out[i] = static_cast<unsigned short>(value & mask);
+                bit_offset += bits_per_entry;
+            }
+        }
+        else
+        {
+            const size_t entries_per_long = 64 / bits_per_entry;
+            size_t long_index = first / entries_per_long;
+            size_t index_in_long = first % entries_per_long;
+            unsigned long long int current = data[long_index] >> (index_in_long * bits_per_entry);
+            for (size_t i = first; i < last; ++i)
+            {
+                if (index_in_long == entries_per_long)
+                {
+                    index_in_long = 0;
+                    long_index += 1;
+                    current = data[long_index];
+                }
+                out[i] = static_cast<unsigned short>(current & mask);
+                current >>= bits_per_entry;
+                index_in_long += 1;
+            }
+        }
+    }
+
+#if defined(__AVX2__)
+    // Process the entries by blocks of a few longs, so the bit
+    // positions of the entries inside a block follow the same
+    // pattern for all blocks. As x86 is little endian, the
+    // long array can be seen as a contiguous stream of bits,
+    // and each entry is gathered from 32 bits at its byte offset.
+    // Returns the number of entries unpacked
+    const size_t UnpackBitsAVX2(const unsigned long long int* data, const size_t data_size,
+        const unsigned char bits_per_entry, const bool spanning,
+        const size_t num_entries, unsigned short* out)
+    {
+        // Max number of entries in a block (7 bits per entry, non spanning)
+        static const size_t MAX_BLOCK_ENTRIES = 72;
+
+        size_t entries_per_block;
+        size_t longs_per_block;
+        if (spanning)
+        {
+            // 64 entries always fill exactly bits_per_entry longs
+            entries_per_block = 64;
+            longs_per_block = bits_per_entry;
+        }
+        else
+        {
+            const size_t entries_per_long = 64 / bits_per_entry;
+            longs_per_block = 1;
+            while ((longs_per_block * entries_per_long) % 8 != 0)
+            {
+                longs_per_block += 1;
+            }
+            entries_per_block = longs_per_block * entries_per_long;
+        }
+
+        if (entries_per_block > MAX_BLOCK_ENTRIES)
+        {
+            return 0;
+        }
+
+        alignas(32) int byte_offsets[MAX_BLOCK_ENTRIES];
+        alignas(32) int shifts[MAX_BLOCK_ENTRIES];
+        for (size_t i = 0; i < entries_per_block; ++i)
+        {
+            const size_t bit_position = spanning ? i * bits_per_entry :
+                (i / (64 / bits_per_entry)) * 64 + (i % (64 / bits_per_entry)) * bits_per_entry;
+            byte_offsets[i] = static_cast<int>(bit_position >> 3);
+            shifts[i] = static_cast<int>(bit_position & 7);
+        }
+
+        const __m256i mask = _mm256_set1_epi32((1 << bits_per_entry) - 1);
+        const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data);
+
+        // The gathers of the last block can read up to 3
+        // bytes after the block, stop one long before the end
+        size_t num_blocks = num_entries / entries_per_block;
+        while (num_blocks > 0 && num_blocks * longs_per_block + 1 > data_size)
+        {
+            num_blocks -= 1;
+        }
+
+        for (size_t b = 0; b < num_blocks; ++b)
+        {
+            const int* block_start = reinterpret_cast<const int*>(bytes + b * longs_per_block * 8);
+            unsigned short* block_out = out + b * entries_per_block;
+            for (size_t i = 0; i < entries_per_block; i += 8)
+            {
+                const __m256i offsets = _mm256_load_si256(reinterpret_cast<const __m256i*>(byte_offsets + i));
+                const __m256i shift = _mm256_load_si256(reinterpret_cast<const __m256i*>(shifts + i));
+                __m256i values = _mm256_i32gather_epi32(block_start, offsets, 1);
+                values = _mm256_and_si256(_mm256_srlv_epi32(values, shift), mask);
+                const __m128i packed = _mm_packus_epi32(_mm256_castsi256_si128(values), _mm256_extracti128_si256(values, 1));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(block_out + i), packed);
+            }
+        }
+
+        return num_blocks * entries_per_block;
+    }
+#endif
+
+    const bool UnpackBits(const unsigned long long int* data, const size_t data_size,
+        const unsigned char bits_per_entry, const bool spanning,
+        const size_t num_entries, unsigned short* out)
+    {
+        if (bits_per_entry == 0 || bits_per_entry > 16)
+        {
+            return false;
+        }
+
+        const size_t required_longs = spanning ? (num_entries * bits_per_entry + 63) / 64 :
+            (num_entries + 64 / bits_per_entry - 1) / (64 / bits_per_entry);
+        if (data_size < required_longs)
+        {
+            return false;
+        }
+
+        size_t done = 0;
+#if defined(__AVX2__)
+        if (bits_per_entry >= 4)
+        {
+            done = UnpackBitsAVX2(data, data_size, bits_per_entry, spanning, num_entries, out);
+        }
+#endif
+        if (done < num_entries)
+        {
+            UnpackBitsScalar(data, bits_per_entry, spanning, done, num_entries, out);
+        }
+
+        return true;
+    }
+} // Botcraft
@@ -0,0 +1,13 @@
+#Add libdeflate library
+
+# libdeflate must be installed on the system
+find_path(LIBDEFLATE_INCLUDE_DIR libdeflate.h)
+find_library(LIBDEFLATE_LIBRARY NAMES deflate libdeflate)
+
+if(NOT LIBDEFLATE_INCLUDE_DIR OR NOT LIBDEFLATE_LIBRARY)
+    message(FATAL_ERROR "Can't find libdeflate, install it or set BOTCRAFT_USE_LIBDEFLATE to OFF")
+endif()
+
+add_library(libdeflate UNKNOWN IMPORTED)
+set_property(TARGET libdeflate PROPERTY IMPORTED_LOCATION ${LIBDEFLATE_LIBRARY})
+set_property(TARGET libdeflate PROPERTY INTERFACE_INCLUDE_DIRECTORIES ${LIBDEFLATE_INCLUDE_DIR})
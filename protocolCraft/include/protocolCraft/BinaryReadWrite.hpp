@@ -5,6 +5,7 @@
 #include <string>
 #include <cstring>
 #include <algorithm>
+#include <memory>
 
 namespace ProtocolCraft
 {
@@ -34,6 +35,45 @@ namespace ProtocolCraft
     std::vector<unsigned char> ReadByteArray(ReadIterator &iter, size_t &length, const size_t &desired_length);
     void WriteByteArray(const std::vector<unsigned char> &my_array, WriteContainer &container);
 
+    // Read only view on a part of a refcounted buffer.
+    // The buffer is kept alive as long as a slice uses it,
+    // so copying a slice never copies the data
+    class ByteSlice
+    {
+    public:
+        ByteSlice();
+        // Create a slice owning a copy of data
+        ByteSlice(const std::vector<unsigned char>& data);
+        ByteSlice(const std::shared_ptr<const std::vector<unsigned char> >& buffer_, const size_t offset_, const size_t size_);
+
+        ReadIterator begin() const;
+        ReadIterator end() const;
+        const unsigned char* data() const;
+        const size_t size() const;
+        const bool empty() const;
+
+    private:
+        std::shared_ptr<const std::vector<unsigned char> > buffer;
+        size_t offset;
+        size_t slice_size;
+    };
+
+    // While an instance of this class is alive, ReadByteSlice
+    // called on the same thread with an iterator inside
+    // buffer will reference it instead of copying the data
+    class SharedReadBufferScope
+    {
+    public:
+        SharedReadBufferScope(const std::shared_ptr<const std::vector<unsigned char> >& buffer);
+        ~SharedReadBufferScope();
+
+    private:
+        std::shared_ptr<const std::vector<unsigned char> > previous_buffer;
+    };
+
+    ByteSlice ReadByteSlice(ReadIterator& iter, size_t& length, const size_t desired_length);
+    void WriteByteSlice(const ByteSlice& slice, WriteContainer& container);
+
     template <typename T>
     T ChangeEndianness(const T& in)
     {
@@ -81,6 +81,11 @@ namespace ProtocolCraft
 #endif
 
         void SetBuffer(const std::vector<unsigned char>& buffer_)
+        {
+            buffer = ByteSlice(buffer_);
+        }
+
+        void SetBuffer(const ByteSlice& buffer_)
         {
             buffer = buffer_;
         }
@@ -138,7 +143,9 @@ namespace ProtocolCraft
 		}
 #endif
 
-        const std::vector<unsigned char>& GetBuffer() const
+        // If the packet has been read inside a SharedReadBufferScope,
+        // this is a slice of the original packet data, not a copy
+        const ByteSlice& GetBuffer() const
         {
             return buffer;
         }
@@ -200,7 +207,7 @@ namespace ProtocolCraft
 #endif
 #endif
             const int buffer_size = ReadData<VarInt>(iter, length);
-            buffer = ReadByteArray(iter, length, buffer_size);
+            buffer = ReadByteSlice(iter, length, buffer_size);
             const int num_block_entities_tags = ReadData<VarInt>(iter, length);
             block_entities_tags = std::vector<NBT>(num_block_entities_tags);
             for (int i = 0; i < num_block_entities_tags; ++i)
@@ -250,7 +257,7 @@ namespace ProtocolCraft
 #endif
 #endif
             WriteData<VarInt>(buffer.size(), container);
-            WriteByteArray(buffer, container);
+            WriteByteSlice(buffer, container);
             WriteData<VarInt>(block_entities_tags.size(), container);
             for (int i = 0; i < block_entities_tags.size(); ++i)
             {
@@ -311,7 +318,7 @@ namespace ProtocolCraft
 #if PROTOCOL_VERSION > 551
 		std::vector<int> biomes;
 #endif
-        std::vector<unsigned char> buffer;
+        ByteSlice buffer;
         std::vector<NBT> block_entities_tags;
 #if PROTOCOL_VERSION < 755
         bool full_chunk;
@@ -49,6 +49,101 @@ namespace ProtocolCraft
         container.insert(container.end(), my_array.begin(), my_array.end());
     }
 
+    // Buffer currently read on this thread, if any
+    thread_local std::shared_ptr<const std::vector<unsigned char> > shared_read_buffer;
+
+    ByteSlice::ByteSlice()
+    {
+        offset = 0;
+        slice_size = 0;
+    }
+
+    ByteSlice::ByteSlice(const std::vector<unsigned char>& data)
+    {
+        buffer = std::make_shared<const std::vector<unsigned char> >(data);
+        offset = 0;
+        slice_size = data.size();
+    }
+
+    ByteSlice::ByteSlice(const std::shared_ptr<const std::vector<unsigned char> >& buffer_, const size_t offset_, const size_t size_)
+    {
+        if (buffer_ == nullptr || offset_ + size_ > buffer_->size())
+        {
+            throw(std::runtime_error("Trying to create a ByteSlice outside of its buffer"));
+        }
+        buffer = buffer_;
+        offset = offset_;
+        slice_size = size_;
+    }
+
+    ReadIterator ByteSlice::begin() const
+    {
+        static const std::vector<unsigned char> empty_buffer;
+        return buffer ? buffer->begin() + offset : empty_buffer.begin();
+    }
+
+    ReadIterator ByteSlice::end() const
+    {
+        return begin() + slice_size;
+    }
+
+    const unsigned char* ByteSlice::data() const
+    {
+        return buffer ? buffer->data() + offset : nullptr;
+    }
+
+    const size_t ByteSlice::size() const
+    {
+        return slice_size;
+    }
+
+    const bool ByteSlice::empty() const
+    {
+        return slice_size == 0;
+    }
+
+    SharedReadBufferScope::SharedReadBufferScope(const std::shared_ptr<const std::vector<unsigned char> >& buffer)
+    {
+        previous_buffer = shared_read_buffer;
+        shared_read_buffer = buffer;
+    }
+
+    SharedReadBufferScope::~SharedReadBufferScope()
+    {
+        shared_read_buffer = previous_buffer;
+    }
+
+    ByteSlice ReadByteSlice(ReadIterator& iter, size_t& length, const size_t desired_length)
+    {
+        if (length < desired_length)
+        {
+            throw(std::runtime_error("Not enough input in ReadByteSlice"));
+        }
+
+        ByteSlice output;
+        // If we are reading from the shared buffer, just keep a reference on it
+        if (desired_length > 0 && shared_read_buffer &&
+            &(*iter) >= shared_read_buffer->data() &&
+            &(*iter) + desired_length <= shared_read_buffer->data() + shared_read_buffer->size())
+        {
+            output = ByteSlice(shared_read_buffer, &(*iter) - shared_read_buffer->data(), desired_length);
+        }
+        else
+        {
+            output = ByteSlice(std::vector<unsigned char>(iter, iter + desired_length));
+        }
+
+        iter += desired_length;
+        length -= desired_length;
+
+        return output;
+    }
+
+    void WriteByteSlice(const ByteSlice& slice, WriteContainer& container)
+    {
+        container.insert(container.end(), slice.begin(), slice.end());
+    }
+
     template<>
     std::string ReadData(ReadIterator& iter, size_t& length)
     {